@@ -1,6 +1,9 @@
 #include "pch.h"
 
+#include <chrono>
 #include <experimental/buffer>
+#include <experimental/io_context>
+#include <string>
 #include <vector>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
@@ -9,6 +12,71 @@ using namespace std::experimental::net;
 
 namespace NetworkingTest
 {
+	// Hands out the input a few bytes at a time, so that delimiters straddle reads.
+	struct ChunkedStream
+	{
+		io_context* context;
+		string input;
+		size_t position;
+		size_t chunk;
+
+		template <class MutableBufferSequence>
+		size_t read_some(const MutableBufferSequence& b, error_code& ec)
+		{
+			if (position == input.size())
+			{
+				ec = stream_errc::eof;
+				return 0;
+			}
+			size_t n{ buffer_copy(b, buffer(input) + position, chunk) };
+			position += n;
+			return n;
+		}
+
+		io_context::executor_type get_executor() noexcept { return context->get_executor(); }
+
+		template <class MutableBufferSequence, class Handler>
+		void async_read_some(const MutableBufferSequence& b, Handler&& handler)
+		{
+			error_code ec;
+			size_t n{ 0 };
+			if (position == input.size())
+				ec = stream_errc::eof;
+			else
+				position += n = buffer_copy(b, buffer(input) + position, chunk);
+			context->get_executor().post([handler = move(handler), ec, n]() mutable { handler(ec, n); }, allocator<void>{});
+		}
+
+		template <class ConstBufferSequence, class Handler>
+		void async_write_some(const ConstBufferSequence& b, Handler&& handler)
+		{
+			size_t n{ min(chunk, buffer_size(b)) };
+			string data(n, '\0');
+			output += data.substr(0, buffer_copy(buffer(data), b, n));
+			context->get_executor().post([handler = move(handler), n]() mutable { handler(error_code{}, n); }, allocator<void>{});
+		}
+
+		string output;
+	};
+
+	// Completes every step in place while the previous one was filled.
+	struct SpeculativeStream : ChunkedStream
+	{
+		size_t tried;
+
+		template <class MutableBufferSequence>
+		size_t _Try_read_some(const MutableBufferSequence& b, error_code& ec)
+		{
+			++tried;
+			if (position == input.size())
+			{
+				ec = make_error_code(errc::operation_would_block);
+				return 0;
+			}
+			return read_some(b, ec);
+		}
+	};
+
 	TEST_CLASS(BufferTest)
 	{
 	public:
@@ -201,5 +269,217 @@ namespace NetworkingTest
 			Assert::AreEqual((const void*)(c + 4), mb.data());
 			Assert::AreEqual(size_t(0), mb.size());
 		}
+
+		TEST_METHOD(CopyTest)
+		{
+			const char src[]{ "hello world" };
+			char a[5]{}, b[8]{};
+			vector<mutable_buffer> dest{ mutable_buffer{ a, sizeof(a) }, mutable_buffer{}, mutable_buffer{ b, sizeof(b) } };
+
+			Assert::AreEqual(size_t(11), buffer_copy(dest, const_buffer{ src, 11 }));
+			Assert::AreEqual(string{ "hello" }, string(a, sizeof(a)));
+			Assert::AreEqual(string{ " world" }, string(b, 6));
+
+			Assert::AreEqual(size_t(3), buffer_copy(dest, const_buffer{ src, 11 }, 3));
+			Assert::AreEqual(size_t(0), buffer_copy(dest, vector<const_buffer>{}));
+		}
+
+		TEST_METHOD(RingBufferTest)
+		{
+			Assert::IsTrue(is_dynamic_buffer_v<dynamic_ring_buffer>);
+
+			ring_buffer r{ 16 };
+			dynamic_ring_buffer d{ dynamic_buffer(r) };
+			d.commit(buffer_copy(d.prepare(10), buffer("0123456789", 10)));
+			d.consume(8);
+			d.commit(buffer_copy(d.prepare(12), buffer("abcdefghijkl", 12)));
+			Assert::AreEqual(size_t(14), d.size());
+			Assert::AreEqual(size_t(16), d.max_size());
+
+			auto data{ d.data() };
+			Assert::AreEqual(size_t(8), data[0].size());
+			Assert::AreEqual(size_t(6), data[1].size());
+			string s(d.size(), '\0');
+			buffer_copy(buffer(s), data);
+			Assert::AreEqual(string{ "89abcdefghijkl" }, s);
+			Assert::ExpectException<length_error>([&d] { d.prepare(3); });
+
+			d.consume(14);
+			Assert::IsTrue(r.empty());
+			Assert::AreEqual(d.data()[0].data(), static_cast<const void*>(d.prepare(16)[0].data()));
+
+			// Only what the last prepare handed out can be committed.
+			d.prepare(4);
+			d.commit(10);
+			Assert::AreEqual(size_t(4), d.size());
+			d.commit(10);
+			Assert::AreEqual(size_t(4), d.size());
+
+			ring_buffer moved{ move(r) };
+			Assert::AreEqual(size_t(4), moved.size());
+			Assert::AreEqual(size_t(16), moved.capacity());
+			Assert::AreEqual(size_t(0), r.size());
+			Assert::AreEqual(size_t(0), r.capacity());
+			Assert::ExpectException<length_error>([&r] { r.prepare(1); });
+			r = move(moved);
+			Assert::AreEqual(size_t(4), r.size());
+			Assert::AreEqual(size_t(0), moved.capacity());
+		}
+
+		TEST_METHOD(ChainedBufferTest)
+		{
+			Assert::IsTrue(is_dynamic_buffer_v<dynamic_chained_buffer>);
+
+			buffer_block_pool pool{ 16 };
+			chained_buffer c{ pool };
+			dynamic_chained_buffer d{ dynamic_buffer(c) };
+			string payload;
+			for (size_t i{ 0 }; i < 100; ++i)
+				payload += static_cast<char>('a' + i % 26);
+			d.commit(buffer_copy(d.prepare(40), buffer(payload, 40)));
+			const void* first{ (*d.data().begin()).data() };
+			d.commit(buffer_copy(d.prepare(60), buffer(payload) + 40));
+			Assert::AreEqual(first, (*d.data().begin()).data());
+			Assert::AreEqual(size_t(100), d.size());
+
+			string s(d.size(), '\0');
+			buffer_copy(buffer(s), d.data());
+			Assert::AreEqual(payload, s);
+
+			d.consume(35);
+			Assert::AreEqual(ptrdiff_t(5), distance(d.data().begin(), d.data().end()));
+			s.assign(d.size(), '\0');
+			buffer_copy(buffer(s), d.data());
+			Assert::AreEqual(payload.substr(35), s);
+
+			d.consume(65);
+			Assert::AreEqual(size_t(16), d.capacity());
+		}
+
+		TEST_METHOD(SearchTest)
+		{
+			const char text[]{ "ab\r\ncd\r" };
+			vector<const_buffer> pieces{ buffer(text, 3), buffer(text + 3, 0), buffer(text + 3, 4), buffer(text + 7, 1) };
+			Assert::IsTrue(make_pair(size_t(4), true) == _Search_delim(pieces, 0, "\r\n"));
+			Assert::IsTrue(make_pair(size_t(7), false) == _Search_delim(pieces, 4, "\r\n"));
+			Assert::IsTrue(make_pair(size_t(5), true) == _Search_delim(pieces, 0, "c"));
+			Assert::IsTrue(make_pair(size_t(6), false) == _Search_delim(pieces, 0, "d\r\n"));
+		}
+
+		TEST_METHOD(ReadUntilTest)
+		{
+			io_context ctx;
+			ChunkedStream s{ &ctx, "GET / HTTP/1.1\r\nHost: a\r\n\r\nbody\n", 0, 5 };
+			string line;
+			Assert::AreEqual(size_t(16), read_until(s, dynamic_buffer(line), "\r\n"));
+			Assert::AreEqual(size_t(20), line.size());
+
+			size_t header{ 0 }, body{ 0 };
+			async_read_until(s, dynamic_buffer(line), "\r\n\r\n", [&](error_code ec, size_t n) {
+				Assert::IsFalse(static_cast<bool>(ec));
+				header = n;
+				async_read_until(s, dynamic_buffer(line), '\n', [&](error_code ec, size_t n) {
+					Assert::IsFalse(static_cast<bool>(ec));
+					body = n;
+				});
+				Assert::AreEqual(size_t(0), body);
+			});
+			ctx.run();
+			Assert::AreEqual(size_t(27), header);
+			Assert::AreEqual(size_t(16), body);
+
+			error_code ec;
+			ring_buffer r{ 8 };
+			s.input.assign(32, 'a');
+			s.position = 0;
+			Assert::AreEqual(size_t(0), read_until(s, dynamic_buffer(r), "\r\n", ec));
+			Assert::IsTrue(ec == stream_errc::not_found);
+		}
+
+		TEST_METHOD(SearchBenchmarkTest)
+		{
+			string data;
+			while (data.size() < 8 * 1024 * 1024)
+				data.append(100 + data.size() % 37, 'x').append("\r\n");
+			data.append("\r\n");
+			buffer_block_pool pool;
+			chained_buffer c{ pool };
+			dynamic_chained_buffer d{ dynamic_buffer(c) };
+			d.commit(buffer_copy(d.prepare(data.size()), buffer(data)));
+			auto buffers{ d.data() };
+			using iterator = _Buffers_iterator<dynamic_chained_buffer::const_buffers_type>;
+			const string_view delim{ "\n\r\n" };
+
+			auto start{ chrono::steady_clock::now() };
+			size_t expected{ static_cast<size_t>(search(iterator::begin(buffers), iterator::end(buffers), delim.begin(), delim.end()) - iterator::begin(buffers)) + delim.size() };
+			auto middle{ chrono::steady_clock::now() };
+			auto [position, found]{ _Search_delim(buffers, 0, delim) };
+			auto stop{ chrono::steady_clock::now() };
+			Assert::IsTrue(found);
+			Assert::AreEqual(expected, position);
+			Logger::WriteMessage(("byte iterator: " + to_string(chrono::duration<double, milli>(middle - start).count()) + " ms, vectorized: " + to_string(chrono::duration<double, milli>(stop - middle).count()) + " ms\n").c_str());
+		}
+
+		TEST_METHOD(AsyncReadTest)
+		{
+			io_context ctx;
+			ChunkedStream s{ &ctx, "0123456789abcdefghij", 0, 5 };
+			char data[12];
+			size_t read{ 0 };
+			async_read(s, buffer(data), [&](error_code ec, size_t n) {
+				Assert::IsFalse(static_cast<bool>(ec));
+				read = n;
+			});
+			Assert::AreEqual(size_t(0), read);
+			ctx.run();
+			Assert::AreEqual(size_t(12), read);
+			Assert::AreEqual(string{ "0123456789ab" }, string(data, sizeof(data)));
+
+			string rest;
+			async_read(s, dynamic_buffer(rest), [&](error_code ec, size_t n) {
+				Assert::IsTrue(ec == stream_errc::eof);
+				read = n;
+			});
+			ctx.restart();
+			ctx.run();
+			Assert::AreEqual(size_t(8), read);
+			Assert::AreEqual(string{ "cdefghij" }, rest);
+
+			SpeculativeStream fast{ { &ctx, string(3000, 'x'), 0, 4096 }, 0 };
+			rest.clear();
+			async_read(fast, dynamic_buffer(rest), transfer_exactly(2000), [&](error_code ec, size_t n) {
+				Assert::IsFalse(static_cast<bool>(ec));
+				read = n;
+			});
+			ctx.restart();
+			Assert::AreEqual(size_t(1), ctx.run());
+			Assert::AreEqual(size_t(2000), read);
+			Assert::IsTrue(fast.tried > 0);
+		}
+
+		TEST_METHOD(AsyncWriteTest)
+		{
+			io_context ctx;
+			ChunkedStream s{ &ctx, "", 0, 7 };
+			const string message{ "composed operations write everything" };
+			size_t written{ 0 };
+			async_write(s, buffer(message), [&](error_code ec, size_t n) {
+				Assert::IsFalse(static_cast<bool>(ec));
+				written = n;
+			});
+			ctx.run();
+			Assert::AreEqual(message.size(), written);
+			Assert::AreEqual(message, s.output);
+
+			string pending{ "hello" };
+			async_write(s, dynamic_buffer(pending), transfer_exactly(3), [&](error_code ec, size_t n) {
+				Assert::IsFalse(static_cast<bool>(ec));
+				written = n;
+			});
+			ctx.restart();
+			ctx.run();
+			Assert::AreEqual(size_t(3), written);
+			Assert::AreEqual(string{ "lo" }, pending);
+		}
 	};
 }
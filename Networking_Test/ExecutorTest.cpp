@@ -0,0 +1,460 @@
+#include "pch.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <experimental/executor>
+#include <experimental/io_context>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace std;
+using namespace std::experimental::net;
+
+namespace NetworkingTest
+{
+	struct DeferChain
+	{
+		atomic<size_t>* executed;
+		size_t remaining;
+
+		void operator()()
+		{
+			executed->fetch_add(1, memory_order_relaxed);
+			if (--remaining)
+				system_executor{}.defer(DeferChain{ executed, remaining }, allocator<void>{});
+		}
+	};
+
+	// The system pool before the work-stealing scheduler, kept as the baseline of the
+	// benchmarks below: one locked queue of std::function shared by every thread.
+	class LegacyPool
+	{
+	public:
+		LegacyPool() : threads_(max(thread::hardware_concurrency(), 1u)), stopped_(false)
+		{
+			for (thread& t : threads_)
+				t = thread([this] { do_job(); });
+		}
+
+		~LegacyPool()
+		{
+			{
+				lock_guard<mutex> lock{ jobs_mutex_ };
+				stopped_ = true;
+			}
+			cond_.notify_all();
+			for (thread& t : threads_)
+				t.join();
+		}
+
+		void post(function<void()>&& f)
+		{
+			{
+				lock_guard<mutex> lock{ jobs_mutex_ };
+				jobs_.emplace_back(move(f));
+			}
+			cond_.notify_one();
+		}
+
+	private:
+		void do_job()
+		{
+			while (true)
+			{
+				function<void()> f;
+				{
+					unique_lock<mutex> lock{ jobs_mutex_ };
+					cond_.wait(lock, [this] { return stopped_ || !jobs_.empty(); });
+					if (stopped_)
+						break;
+					f = move(jobs_.front());
+					jobs_.pop_front();
+				}
+				f();
+			}
+		}
+
+		deque<thread> threads_;
+		deque<function<void()>> jobs_;
+		mutex jobs_mutex_;
+		condition_variable cond_;
+		bool stopped_;
+	};
+
+	struct LegacyChain
+	{
+		LegacyPool* pool;
+		atomic<size_t>* executed;
+		size_t remaining;
+
+		void operator()()
+		{
+			executed->fetch_add(1, memory_order_relaxed);
+			if (--remaining)
+				pool->post(LegacyChain{ pool, executed, remaining });
+		}
+	};
+
+	static double WaitFor(const atomic<size_t>& executed, size_t count, chrono::steady_clock::time_point start)
+	{
+		while (executed.load() < count)
+		{
+			Assert::IsTrue(chrono::steady_clock::now() - start < chrono::minutes(1));
+			this_thread::yield();
+		}
+		return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	}
+
+	template <class T>
+	struct CountingAllocator
+	{
+		using value_type = T;
+
+		size_t* count;
+
+		CountingAllocator(size_t* count) noexcept : count(count) {}
+		template <class U>
+		CountingAllocator(const CountingAllocator<U>& other) noexcept : count(other.count)
+		{
+		}
+
+		T* allocate(size_t n)
+		{
+			++*count;
+			return allocator<T>{}.allocate(n);
+		}
+		void deallocate(T* p, size_t n) noexcept
+		{
+			--*count;
+			allocator<T>{}.deallocate(p, n);
+		}
+
+		template <class U>
+		bool operator==(const CountingAllocator<U>& other) const noexcept { return count == other.count; }
+		template <class U>
+		bool operator!=(const CountingAllocator<U>& other) const noexcept { return count != other.count; }
+	};
+
+	// An executor whose copy is allowed to throw.
+	struct ThrowingCopyExecutor
+	{
+		io_context::executor_type inner;
+
+		ThrowingCopyExecutor(io_context::executor_type inner) noexcept : inner(inner) {}
+		ThrowingCopyExecutor(const ThrowingCopyExecutor& other) : inner(other.inner) {}
+
+		execution_context& context() const noexcept { return inner.context(); }
+		void on_work_started() const noexcept { inner.on_work_started(); }
+		void on_work_finished() const noexcept { inner.on_work_finished(); }
+		template <class Func, class ProtoAllocator>
+		void dispatch(Func&& f, const ProtoAllocator& a) const { inner.dispatch(forward<Func>(f), a); }
+		template <class Func, class ProtoAllocator>
+		void post(Func&& f, const ProtoAllocator& a) const { inner.post(forward<Func>(f), a); }
+		template <class Func, class ProtoAllocator>
+		void defer(Func&& f, const ProtoAllocator& a) const { inner.defer(forward<Func>(f), a); }
+
+		bool operator==(const ThrowingCopyExecutor& other) const noexcept { return inner == other.inner; }
+		bool operator!=(const ThrowingCopyExecutor& other) const noexcept { return inner != other.inner; }
+	};
+
+#ifdef NET_HAS_COROUTINE
+	static awaitable<int> AddOne(int i)
+	{
+		co_return i + 1;
+	}
+
+	static awaitable<long long> SumAll(int n)
+	{
+		long long sum{ 0 };
+		for (int i{ 0 }; i < n; ++i)
+			sum += co_await AddOne(i);
+		co_return sum;
+	}
+
+	static awaitable<void> Fail()
+	{
+		co_await AddOne(0);
+		throw runtime_error{ "fail" };
+	}
+
+	static awaitable<void> PostMany(io_context& ctx, size_t count, size_t& executed)
+	{
+		for (size_t i{ 0 }; i < count; ++i)
+		{
+			co_await post(ctx, use_awaitable);
+			executed++;
+		}
+	}
+
+	static awaitable<int> Hold(shared_ptr<int> p)
+	{
+		co_return *p;
+	}
+
+	struct NoDefault
+	{
+		explicit NoDefault(int value) noexcept : value(value) {}
+
+		int value;
+	};
+
+	static awaitable<NoDefault> MakeNoDefault(bool fail)
+	{
+		if (fail)
+			throw runtime_error{ "fail" };
+		co_return NoDefault{ 5 };
+	}
+
+	struct SetOnExit
+	{
+		bool* flag;
+
+		~SetOnExit() { *flag = true; }
+	};
+
+	static awaitable<void> WaitOn(io_context& other, bool& resumed, bool& destroyed)
+	{
+		SetOnExit exit{ &destroyed };
+		co_await post(other, use_awaitable);
+		resumed = true;
+	}
+
+	struct PostChain
+	{
+		io_context* ctx;
+		size_t* executed;
+		size_t remaining;
+
+		void operator()()
+		{
+			++*executed;
+			if (--remaining)
+				post(*ctx, PostChain{ ctx, executed, remaining });
+		}
+	};
+#endif
+
+	TEST_CLASS(ExecutorTest)
+	{
+	public:
+		TEST_METHOD(SystemPostTest)
+		{
+			constexpr size_t count{ 1000000 };
+			atomic<size_t> executed{ 0 };
+			// Both pools have their threads running before the clock starts, and take turns so that neither
+			// always runs on a cold heap. The best round of each is logged.
+			system_executor{}.context();
+			LegacyPool legacy;
+			double elapsed{ numeric_limits<double>::max() };
+			double baseline{ numeric_limits<double>::max() };
+			for (int round{ 0 }; round < 3; ++round)
+			{
+				executed = 0;
+				auto start{ chrono::steady_clock::now() };
+				for (size_t i{ 0 }; i < count; ++i)
+					system_executor{}.post([&executed] { executed.fetch_add(1, memory_order_relaxed); }, allocator<void>{});
+				elapsed = min(elapsed, WaitFor(executed, count, start));
+				Assert::AreEqual(count, executed.load());
+
+				executed = 0;
+				start = chrono::steady_clock::now();
+				for (size_t i{ 0 }; i < count; ++i)
+					legacy.post([&executed] { executed.fetch_add(1, memory_order_relaxed); });
+				baseline = min(baseline, WaitFor(executed, count, start));
+				Assert::AreEqual(count, executed.load());
+			}
+			Logger::WriteMessage(("post: " + to_string(static_cast<size_t>(count / elapsed)) + " handlers/s, legacy pool: " + to_string(static_cast<size_t>(count / baseline)) + " handlers/s\n").c_str());
+		}
+
+		TEST_METHOD(SystemDeferTest)
+		{
+			constexpr size_t chains{ 64 };
+			constexpr size_t length{ 16384 };
+			atomic<size_t> executed{ 0 };
+			auto start{ chrono::steady_clock::now() };
+			for (size_t i{ 0 }; i < chains; ++i)
+				system_executor{}.post(DeferChain{ &executed, length }, allocator<void>{});
+			double elapsed{ WaitFor(executed, chains * length, start) };
+			Assert::AreEqual(chains * length, executed.load());
+
+			// The legacy pool had no defer, so its chains go through post.
+			LegacyPool legacy;
+			executed = 0;
+			start = chrono::steady_clock::now();
+			for (size_t i{ 0 }; i < chains; ++i)
+				legacy.post(LegacyChain{ &legacy, &executed, length });
+			double baseline{ WaitFor(executed, chains * length, start) };
+			Assert::AreEqual(chains * length, executed.load());
+			Logger::WriteMessage(("defer: " + to_string(static_cast<size_t>(chains * length / elapsed)) + " handlers/s, legacy pool: " + to_string(static_cast<size_t>(chains * length / baseline)) + " handlers/s\n").c_str());
+		}
+
+		TEST_METHOD(PolymorphicExecutorTest)
+		{
+			io_context ctx;
+			io_context ctx2;
+			executor ex{ ctx.get_executor() };
+			Assert::IsTrue(ex.target<io_context::executor_type>() != nullptr);
+			Assert::IsTrue(*ex.target<io_context::executor_type>() == ctx.get_executor());
+			Assert::IsNull(ex.target<system_executor>());
+			Assert::IsTrue(ex.target_type() == typeid(io_context::executor_type));
+
+			// Copies compare by their targets.
+			executor copy{ ex };
+			Assert::IsTrue(copy == ex);
+			Assert::IsTrue(executor{ ctx.get_executor() } == ex);
+			Assert::IsTrue(executor{ ctx2.get_executor() } != ex);
+			executor moved{ move(copy) };
+			Assert::IsFalse((bool)copy);
+			Assert::IsTrue(moved == ex);
+			moved = system_executor{};
+			Assert::IsTrue(moved.target<system_executor>() != nullptr);
+			moved.swap(copy);
+			Assert::IsFalse((bool)moved);
+			Assert::IsTrue(copy == executor{ system_executor{} });
+
+			strand<io_context::executor_type> s{ ctx.get_executor() };
+			executor sex{ s };
+			Assert::IsTrue(sex == executor{ s });
+			Assert::IsTrue(sex != executor{ strand<io_context::executor_type>{ ctx.get_executor() } });
+
+			// Small handlers are stored inline, larger ones with the allocator they come with.
+			size_t allocated{ 0 };
+			size_t executed{ 0 };
+			array<char, 128> payload{};
+			ex.post([&executed] { executed++; }, CountingAllocator<void>{ &allocated });
+			Assert::AreEqual(size_t(0), allocated);
+			ex.post([&executed, payload] { executed += payload.size(); }, CountingAllocator<void>{ &allocated });
+			Assert::AreEqual(size_t(1), allocated);
+			sex.post([&executed] { executed++; }, allocator<void>{});
+			ctx.run();
+			Assert::AreEqual(size_t(0), allocated);
+			Assert::AreEqual(size_t(2 + payload.size()), executed);
+
+			// An executor that may throw when copied is not kept inline.
+			{
+				executor shared{ allocator_arg, CountingAllocator<void>{ &allocated }, ThrowingCopyExecutor{ ctx.get_executor() } };
+				Assert::AreEqual(size_t(1), allocated);
+				executor copy{ shared };
+				Assert::AreEqual(size_t(1), allocated);
+				Assert::IsTrue(copy == shared);
+				Assert::IsTrue(copy.target<ThrowingCopyExecutor>() != nullptr);
+			}
+			Assert::AreEqual(size_t(0), allocated);
+		}
+
+		TEST_METHOD(PolymorphicPostTest)
+		{
+			constexpr size_t count{ 1000000 };
+			io_context ctx;
+			size_t executed{ 0 };
+			auto concrete{ ctx.get_executor() };
+			executor ex{ concrete };
+			// The best of a few rounds, so a single slow round does not skew the comparison.
+			double direct{ numeric_limits<double>::max() }, erased{ numeric_limits<double>::max() };
+			for (int round{ 0 }; round < 5; ++round)
+			{
+				auto start{ chrono::steady_clock::now() };
+				for (size_t i{ 0 }; i < count; ++i)
+					concrete.post([&executed] { executed++; }, allocator<void>{});
+				ctx.run();
+				ctx.restart();
+				direct = (min)(direct, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+
+				start = chrono::steady_clock::now();
+				for (size_t i{ 0 }; i < count; ++i)
+					ex.post([&executed] { executed++; }, allocator<void>{});
+				ctx.run();
+				ctx.restart();
+				erased = (min)(erased, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+			}
+			Assert::AreEqual(10 * count, executed);
+			Logger::WriteMessage(("io_context::executor_type: " + to_string(direct * 1e9 / count) + " ns/post, executor: " + to_string(erased * 1e9 / count) + " ns/post\n").c_str());
+		}
+
+#ifdef NET_HAS_COROUTINE
+		TEST_METHOD(CoroutineTest)
+		{
+			io_context ctx;
+			long long sum{ 0 };
+			bool failed{ false };
+			// A long chain of awaits completing at once must not grow the stack.
+			co_spawn(ctx, SumAll(1000000), [&](exception_ptr e, long long value) {
+				Assert::IsFalse((bool)e);
+				sum = value;
+			});
+			co_spawn(ctx.get_executor(), Fail(), [&](exception_ptr e) { failed = (bool)e; });
+			co_spawn(ctx, SumAll(10), detached);
+			ctx.run();
+			Assert::AreEqual(500000500000ll, sum);
+			Assert::IsTrue(failed);
+		}
+
+		TEST_METHOD(CoroutineAbandonTest)
+		{
+			io_context ctx;
+			bool resumed{ false }, destroyed{ false }, completed{ false };
+			{
+				io_context other;
+				co_spawn(ctx, WaitOn(other, resumed, destroyed), [&](exception_ptr) { completed = true; });
+				ctx.poll();
+				Assert::IsFalse(destroyed);
+			}
+			// The frames are destroyed with the handler, and the coroutine never runs again.
+			Assert::IsTrue(destroyed);
+			Assert::IsFalse(resumed);
+			Assert::IsFalse(completed);
+			Assert::AreEqual(size_t(0), ctx.run());
+		}
+
+		TEST_METHOD(CoroutineHandlerThrowTest)
+		{
+			io_context ctx;
+			auto held{ make_shared<int>(1) };
+			co_spawn(ctx, Hold(held), [](exception_ptr, int) { throw runtime_error{ "handler" }; });
+			Assert::ExpectException<runtime_error>([&ctx] { ctx.run(); });
+			// The frame, and the coroutine it awaited, are gone with the work they kept.
+			Assert::AreEqual(1l, held.use_count());
+			Assert::AreEqual(size_t(0), ctx.run());
+
+			ctx.restart();
+			int value{ 0 };
+			bool failed{ false };
+			co_spawn(ctx, MakeNoDefault(false), [&value](exception_ptr, optional<NoDefault> v) { value = v->value; });
+			co_spawn(ctx, MakeNoDefault(true), [&failed](exception_ptr e, optional<NoDefault> v) { failed = e && !v; });
+			ctx.run();
+			Assert::AreEqual(5, value);
+			Assert::IsTrue(failed);
+		}
+
+		TEST_METHOD(CoroutinePostTest)
+		{
+			constexpr size_t count{ 1000000 };
+			io_context ctx;
+			size_t executed{ 0 };
+			auto start{ chrono::steady_clock::now() };
+			post(ctx, PostChain{ &ctx, &executed, count });
+			ctx.run();
+			double callbacks{ chrono::duration<double>(chrono::steady_clock::now() - start).count() };
+
+			ctx.restart();
+			start = chrono::steady_clock::now();
+			co_spawn(ctx, PostMany(ctx, count, executed), detached);
+			ctx.run();
+			double coroutine{ chrono::duration<double>(chrono::steady_clock::now() - start).count() };
+			Assert::AreEqual(2 * count, executed);
+			Logger::WriteMessage(("callbacks: " + to_string(callbacks * 1e9 / count) + " ns/post, coroutine: " + to_string(coroutine * 1e9 / count) + " ns/post\n").c_str());
+		}
+#endif
+	};
+}
@@ -1,6 +1,9 @@
 #include "pch.h"
 
 #include "InternetTest.h"
+#include <map>
+#include <random>
+#include <unordered_set>
 
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
@@ -207,5 +210,389 @@ namespace NetworkingTest
 			auto addrs2{ res.resolve(home) };
 			Assert::IsTrue(addrs == addrs2);
 		}
+
+		TEST_METHOD(ResolverCacheTest)
+		{
+			io_context ctx;
+			resolver_cache& cache{ make_service<resolver_cache>(ctx, chrono::minutes{ 1 }, chrono::minutes{ 1 }) };
+			tcp::resolver res{ ctx };
+			auto addrs{ res.resolve("localhost", "http") };
+			Assert::AreEqual(size_t(1), cache.size());
+			Assert::IsTrue(addrs == res.resolve("localhost", "http"));
+			Assert::AreEqual(size_t(1), cache.size());
+
+			// Failures are cached as well.
+			error_code ec{};
+			auto flags{ resolver_base::numeric_host | tcp::resolver::numeric_service };
+			Assert::IsTrue(res.resolve("localhost", "42", flags, ec).empty());
+			Assert::IsTrue(!!ec);
+			Assert::AreEqual(size_t(2), cache.size());
+			error_code ec2{};
+			res.resolve("localhost", "42", flags, ec2);
+			Assert::IsTrue(ec == ec2);
+
+			// Overlapping asynchronous lookups share one query.
+			cache.clear();
+			size_t completed{ 0 };
+			for (int i = 0; i < 4; i++)
+			{
+				res.async_resolve("localhost", "http", [&](const error_code& ec, tcp::resolver::results_type results) {
+					Assert::IsTrue(!ec);
+					Assert::IsTrue(addrs == results);
+					completed++;
+				});
+			}
+			ctx.run();
+			Assert::AreEqual(size_t(4), completed);
+			Assert::AreEqual(size_t(1), cache.size());
+
+			// A synchronous lookup does not wait for an asynchronous one, which only completes through run().
+			cache.clear();
+			completed = 0;
+			res.async_resolve("localhost", "http", [&](const error_code& ec, tcp::resolver::results_type results) {
+				Assert::IsTrue(!ec);
+				Assert::IsTrue(addrs == results);
+				completed++;
+			});
+			Assert::IsTrue(addrs == res.resolve("localhost", "http"));
+			ctx.restart();
+			ctx.run();
+			Assert::AreEqual(size_t(1), completed);
+		}
+
+		TEST_METHOD(StreambufConnectTest)
+		{
+			io_context ctx;
+			resolver_cache& cache{ make_service<resolver_cache>(ctx, chrono::minutes{ 1 }, chrono::minutes{ 1 }) };
+			tcp::acceptor acceptor{ ctx, tcp::endpoint{ address_v4::loopback(), 0 } };
+			string port{ to_string(acceptor.local_endpoint().port()) };
+			basic_socket_streambuf<tcp> sb{ tcp::socket{ ctx } };
+			Assert::IsTrue(sb.connect("127.0.0.1", port) == &sb);
+			Assert::IsFalse((bool)sb.error());
+			tcp::socket first{ acceptor.accept() };
+			Assert::IsTrue(first.remote_endpoint() == sb.socket().local_endpoint());
+			Assert::AreEqual(size_t(1), cache.size());
+
+			// Connecting again replaces the connection, and the lookup comes from the cache.
+			Assert::IsTrue(sb.connect("127.0.0.1", port) == &sb);
+			tcp::socket second{ acceptor.accept() };
+			Assert::IsTrue(second.remote_endpoint() == sb.socket().local_endpoint());
+			Assert::AreEqual(size_t(1), cache.size());
+
+			Assert::AreEqual(streamsize(5), sb.sputn("hello", 5));
+			Assert::AreEqual(0, sb.pubsync());
+			char received[5];
+			read(second, buffer(received));
+			Assert::AreEqual(string{ "hello" }, string(received, 5));
+			write(second, buffer("world", 5));
+			char echoed[5];
+			Assert::AreEqual(streamsize(5), sb.sgetn(echoed, 5));
+			Assert::AreEqual(string{ "world" }, string(echoed, 5));
+
+			Assert::IsTrue(sb.close() == &sb);
+			Assert::IsFalse(sb.socket().is_open());
+			Assert::IsTrue(sb.close() == &sb);
+
+			acceptor.close();
+			Assert::IsNull(sb.connect("127.0.0.1", port));
+			Assert::IsTrue((bool)sb.error());
+		}
+
+		TEST_METHOD(ResolverCacheBenchmarkTest)
+		{
+			constexpr int count{ 1000 };
+			io_context ctx;
+			tcp::resolver res{ ctx };
+			auto start{ chrono::steady_clock::now() };
+			for (int i = 0; i < count; i++)
+				res.resolve("localhost", "http");
+			double uncached{ chrono::duration<double>(chrono::steady_clock::now() - start).count() };
+
+			make_service<resolver_cache>(ctx);
+			start = chrono::steady_clock::now();
+			for (int i = 0; i < count; i++)
+				res.resolve("localhost", "http");
+			double cached{ chrono::duration<double>(chrono::steady_clock::now() - start).count() };
+			Logger::WriteMessage(("getaddrinfo: " + to_string(static_cast<size_t>(count / uncached)) + " lookups/s, cached: " + to_string(static_cast<size_t>(count / cached)) + " lookups/s\n").c_str());
+		}
+
+		TEST_METHOD(NetworkTableTest)
+		{
+			network_table<int> table;
+			Assert::IsNull(table.find(make_address_v4("10.1.2.3")));
+			pair<const char*, int> nets[]{ { "0.0.0.0/0", 0 }, { "10.0.0.0/8", 8 }, { "10.1.0.0/16", 16 }, { "10.1.2.0/24", 24 }, { "10.1.2.128/25", 25 }, { "10.1.2.129/32", 32 }, { "2001:db8::/32", 32 }, { "2001:db8:1::/48", 48 } };
+			table.insert(begin(nets), end(nets));
+			Assert::AreEqual(size_t(8), table.size());
+			Assert::AreEqual(0, *table.find(make_address_v4("192.168.0.1")));
+			Assert::AreEqual(8, *table.find(make_address_v4("10.200.0.1")));
+			Assert::AreEqual(16, *table.find(make_address_v4("10.1.3.1")));
+			Assert::AreEqual(24, *table.find(make_address_v4("10.1.2.127")));
+			Assert::AreEqual(25, *table.find(make_address_v4("10.1.2.130")));
+			Assert::AreEqual(32, *table.find(make_address("10.1.2.129")));
+			Assert::AreEqual(48, *table.find(make_address_v6("2001:db8:1::1")));
+			Assert::AreEqual(32, *table.find(make_address_v6("2001:db8:2::1")));
+			Assert::IsNull(table.find(make_address_v6("2001:db9::1")));
+
+			// A network inserted again replaces its value.
+			table.insert(make_network_v4("10.1.0.0/16"), 17);
+			Assert::AreEqual(17, *table.find(make_address_v4("10.1.3.1")));
+			Assert::AreEqual(24, *table.find(make_address_v4("10.1.2.1")));
+			// Host bits do not make it another network, and the table does not grow.
+			table.insert("10.1.2.3/24", 23);
+			table.insert(make_network_v6("2001:db8::/32"), 33);
+			Assert::AreEqual(size_t(8), table.size());
+			Assert::AreEqual(23, *table.find(make_address_v4("10.1.2.1")));
+			Assert::AreEqual(33, *table.find(make_address_v6("2001:db8:2::1")));
+
+			error_code ec{};
+			table.insert("10.0.0.0/33", 0, ec);
+			Assert::IsTrue(!!ec);
+
+			address_v4 addrs[]{ make_address_v4("10.1.2.1"), make_address_v4("10.9.9.9") };
+			const int* found[2]{};
+			table.find(begin(addrs), end(addrs), found);
+			Assert::AreEqual(23, *found[0]);
+			Assert::AreEqual(8, *found[1]);
+
+			table.clear();
+			Assert::IsTrue(table.empty());
+			Assert::IsNull(table.find(make_address_v4("10.1.2.1")));
+		}
+
+		TEST_METHOD(NetworkTableBenchmarkTest)
+		{
+			constexpr size_t nets_count{ 10000 };
+			constexpr size_t count{ 1000000 };
+			mt19937 gen{ 42 };
+			vector<network_v4> nets;
+			network_table<size_t> table;
+			for (size_t i = 0; i < nets_count; i++)
+			{
+				network_v4 net{ address_v4{ gen() }, static_cast<int>(8 + gen() % 25) };
+				nets.push_back(net);
+				table.insert(net, i);
+			}
+			vector<address_v4> addrs;
+			for (size_t i = 0; i < count; i++)
+				addrs.push_back(i % 2 ? address_v4{ gen() } : nets[gen() % nets_count].network());
+
+			vector<const size_t*> found(count);
+			auto start{ chrono::steady_clock::now() };
+			table.find(addrs.begin(), addrs.end(), found.begin());
+			double trie{ chrono::duration<double>(chrono::steady_clock::now() - start).count() };
+
+			// A linear scan, checked against the table on a sample.
+			constexpr size_t scan_count{ 1000 };
+			start = chrono::steady_clock::now();
+			for (size_t i = 0; i < scan_count; i++)
+			{
+				const network_v4 host{ addrs[i], 32 };
+				int best{ -1 };
+				size_t value{ 0 };
+				for (size_t j = 0; j < nets_count; j++)
+				{
+					if (nets[j].prefix_length() >= best && (host == nets[j].canonical() || host.is_subnet_of(nets[j])))
+					{
+						best = nets[j].prefix_length();
+						value = j;
+					}
+				}
+				Assert::AreEqual(best >= 0, found[i] != nullptr);
+				if (found[i])
+					Assert::AreEqual(nets[value].prefix_length(), nets[*found[i]].prefix_length());
+			}
+			double scan{ chrono::duration<double>(chrono::steady_clock::now() - start).count() };
+			Logger::WriteMessage(("network_table: " + to_string(trie * 1e9 / count) + " ns/lookup, linear scan: " + to_string(scan * 1e9 / scan_count) + " ns/lookup\n").c_str());
+		}
+
+		TEST_METHOD(AddressCharsTest)
+		{
+			mt19937 gen{ 7 };
+			char str[64];
+			for (int i = 0; i < 10000; i++)
+			{
+				address_v4 a4{ gen() };
+				char ref[INET_ADDRSTRLEN];
+				::inet_ntop(AF_INET, &a4._Addr(), ref, sizeof(ref));
+				*to_chars(str, str + sizeof(str), a4).ptr = '\0';
+				Assert::AreEqual(ref, str);
+				Assert::IsTrue(a4 == make_address_v4(string_view{ ref }));
+
+				address_v6::bytes_type bytes;
+				for (auto& b : bytes)
+					b = static_cast<unsigned char>(gen());
+				// Zero runs exercise the "::" compression.
+				for (int j = 0; j < 8; j++)
+				{
+					if (gen() % 2)
+						bytes[2 * j] = bytes[2 * j + 1] = 0;
+				}
+				address_v6 a6{ bytes };
+				*to_chars(str, str + sizeof(str), a6).ptr = '\0';
+				::in6_addr addr;
+				Assert::AreEqual(1, ::inet_pton(AF_INET6, str, &addr));
+				Assert::IsTrue(a6 == address_v6{ addr, 0 });
+				char ref6[INET6_ADDRSTRLEN];
+				::inet_ntop(AF_INET6, &a6._Addr(), ref6, sizeof(ref6));
+				Assert::IsTrue(a6 == make_address_v6(string_view{ ref6 }));
+			}
+
+			Assert::AreEqual("::ffff:1.2.3.4", make_address("::ffff:1.2.3.4").to_string().c_str());
+			Assert::AreEqual("fe80::1%12", make_address_v6("FE80::1%12").to_string().c_str());
+			Assert::AreEqual("2001:db8::/32", make_network_v6("2001:db8:0::/32").to_string().c_str());
+			Assert::AreEqual("10.0.0.0/8", make_network_v4("10.0.0.0/8").to_string().c_str());
+			Assert::IsTrue(to_chars(str, str + 8, make_address_v4("192.168.100.100")).ec == errc::value_too_large);
+
+			const char* invalid[]{ "", "1.2.3", "1.2.3.4.5", "01.2.3.4", "1:2:3:4:5:6:7:8:9", "1::2::3", ":1::", "1:2:3:4:5:6:7:1.2.3.4", "12345::", "fe80::1%" };
+			for (const char* s : invalid)
+			{
+				error_code ec{};
+				make_address(s, ec);
+				Assert::IsTrue(!!ec);
+			}
+			error_code ec{};
+			make_network_v4("10.0.0.0/", ec);
+			Assert::IsTrue(!!ec);
+			make_network_v6("::/129", ec);
+			Assert::IsTrue(!!ec);
+		}
+
+		TEST_METHOD(AddressCharsBenchmarkTest)
+		{
+			constexpr size_t count{ 1000000 };
+			mt19937 gen{ 42 };
+			vector<string> strs;
+			for (size_t i = 0; i < count; i++)
+				strs.push_back(i % 2 ? address_v4{ gen() }.to_string() : "2001:db8::" + address_v4{ gen() }.to_string());
+			size_t checksum{ 0 };
+			auto start{ chrono::steady_clock::now() };
+			for (const string& s : strs)
+			{
+				::in6_addr addr;
+				checksum += ::inet_pton(s.find(':') != string::npos ? AF_INET6 : AF_INET, s.c_str(), &addr);
+			}
+			double pton{ chrono::duration<double>(chrono::steady_clock::now() - start).count() };
+			start = chrono::steady_clock::now();
+			for (const string& s : strs)
+			{
+				error_code ec{};
+				make_address(string_view{ s }, ec);
+				checksum += !ec;
+			}
+			double parse{ chrono::duration<double>(chrono::steady_clock::now() - start).count() };
+			Assert::AreEqual(2 * count, checksum);
+
+			vector<address_v6> addrs;
+			for (size_t i = 0; i < count; i++)
+				addrs.push_back(make_address_v6(v4_mapped, address_v4{ gen() }));
+			char str[INET6_ADDRSTRLEN];
+			start = chrono::steady_clock::now();
+			for (const address_v6& a : addrs)
+				checksum += strlen(::inet_ntop(AF_INET6, &a._Addr(), str, sizeof(str)));
+			double ntop{ chrono::duration<double>(chrono::steady_clock::now() - start).count() };
+			start = chrono::steady_clock::now();
+			for (const address_v6& a : addrs)
+				checksum += static_cast<size_t>(to_chars(str, str + sizeof(str), a).ptr - str);
+			double format{ chrono::duration<double>(chrono::steady_clock::now() - start).count() };
+			Logger::WriteMessage(("inet_pton: " + to_string(pton * 1e9 / count) + " ns, make_address: " + to_string(parse * 1e9 / count) + " ns, inet_ntop: " + to_string(ntop * 1e9 / count) + " ns, to_chars: " + to_string(format * 1e9 / count) + " ns\n").c_str());
+		}
+
+		TEST_METHOD(EndpointHashTest)
+		{
+			hash<udp::endpoint> h{};
+			udp::endpoint a{ make_address("fe80::1%3"), 5353 };
+			Assert::IsTrue(a == udp::endpoint{ make_address("fe80::1%3"), 5353 });
+			Assert::AreEqual(h(a), h(udp::endpoint{ make_address("fe80::1%3"), 5353 }));
+			Assert::AreNotEqual(h(a), h(udp::endpoint{ make_address("fe80::1%4"), 5353 }));
+			Assert::AreNotEqual(h(a), h(udp::endpoint{ make_address("fe80::1%3"), 5354 }));
+
+			// Neighbouring addresses and ports should not collide.
+			unordered_set<size_t> hashes;
+			for (unsigned i = 0; i < 256; i++)
+			{
+				for (port_type port = 1000; port < 1256; port++)
+					hashes.insert(h(udp::endpoint{ address_v4{ 0x0A000000 | i }, port }));
+			}
+			Assert::AreEqual(size_t(256 * 256), hashes.size());
+			Assert::AreNotEqual(hash<address_v4>{}(address_v4{ 1 }), hash<address_v4>{}(address_v4{ 2 }));
+		}
+
+		TEST_METHOD(EndpointMapTest)
+		{
+			endpoint_map<string> peers;
+			udp::endpoint a{ make_address("10.0.0.1"), 4000 };
+			udp::endpoint b{ make_address("10.0.0.1"), 4001 };
+			udp::endpoint c{ make_address("2001:db8::1"), 4000 };
+			Assert::IsNull(peers.find(a));
+			Assert::IsTrue(peers.insert(a, "a").second);
+			Assert::IsFalse(peers.insert(a, "x").second);
+			peers[b] = "b";
+			peers.try_emplace(c, "c");
+			Assert::AreEqual(size_t(3), peers.size());
+			Assert::AreEqual("a", peers.find(a)->c_str());
+			Assert::AreEqual("b", peers.find(b)->c_str());
+			Assert::AreEqual("c", peers.find(c)->c_str());
+
+			size_t count{ 0 };
+			peers.for_each([&](const udp::endpoint& ep, const string& value) {
+				Assert::IsTrue(peers.find(ep) != nullptr);
+				Assert::AreEqual(peers.find(ep)->c_str(), value.c_str());
+				count++;
+			});
+			Assert::AreEqual(size_t(3), count);
+
+			Assert::AreEqual(size_t(1), peers.erase(b));
+			Assert::AreEqual(size_t(0), peers.erase(b));
+			Assert::IsNull(peers.find(b));
+			Assert::AreEqual("c", peers.find(c)->c_str());
+
+			// Growing and erasing keep every entry reachable.
+			for (unsigned i = 0; i < 10000; i++)
+				peers[udp::endpoint{ address_v4{ i }, static_cast<port_type>(i) }] = to_string(i);
+			for (unsigned i = 0; i < 10000; i += 2)
+				peers.erase(udp::endpoint{ address_v4{ i }, static_cast<port_type>(i) });
+			for (unsigned i = 0; i < 10000; i++)
+			{
+				const string* value{ peers.find(udp::endpoint{ address_v4{ i }, static_cast<port_type>(i) }) };
+				if (i % 2)
+					Assert::AreEqual(to_string(i).c_str(), value->c_str());
+				else
+					Assert::IsNull(value);
+			}
+			Assert::AreEqual(size_t(5002), peers.size());
+			peers.clear();
+			Assert::IsTrue(peers.empty());
+		}
+
+		TEST_METHOD(EndpointMapBenchmarkTest)
+		{
+			constexpr size_t peers_count{ 10000 };
+			constexpr size_t count{ 1000000 };
+			mt19937 gen{ 42 };
+			vector<udp::endpoint> eps;
+			endpoint_map<size_t> peers;
+			map<string, size_t> names;
+			for (size_t i = 0; i < peers_count; i++)
+			{
+				eps.emplace_back(address_v4{ gen() }, static_cast<port_type>(gen()));
+				peers[eps.back()] = i;
+				names[eps.back().address().to_string() + ":" + to_string(eps.back().port())] = i;
+			}
+
+			size_t checksum{ 0 };
+			auto start{ chrono::steady_clock::now() };
+			for (size_t i = 0; i < count; i++)
+			{
+				const udp::endpoint& ep{ eps[i % peers_count] };
+				checksum += names.find(ep.address().to_string() + ":" + to_string(ep.port()))->second;
+			}
+			double by_name{ chrono::duration<double>(chrono::steady_clock::now() - start).count() };
+			start = chrono::steady_clock::now();
+			for (size_t i = 0; i < count; i++)
+				checksum -= *peers.find(eps[i % peers_count]);
+			double flat{ chrono::duration<double>(chrono::steady_clock::now() - start).count() };
+			Assert::AreEqual(size_t(0), checksum);
+			Logger::WriteMessage(("map on to_string: " + to_string(by_name * 1e9 / count) + " ns/lookup, endpoint_map: " + to_string(flat * 1e9 / count) + " ns/lookup\n").c_str());
+		}
 	};
 }
@@ -0,0 +1,233 @@
+#include "pch.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <experimental/executor>
+#include <experimental/internet>
+#include <experimental/io_context>
+#include <experimental/socket>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace std;
+using namespace std::experimental::net;
+using namespace std::experimental::net::ip;
+
+// The replacement is global to the test module, so every replaceable form is counted,
+// not only the one the recycling allocator happens to call.
+atomic<size_t> allocation_count{ 0 };
+
+static void* counted_alloc(size_t n) noexcept
+{
+	allocation_count.fetch_add(1, memory_order_relaxed);
+	return malloc(n ? n : 1);
+}
+
+static void* counted_alloc(size_t n, align_val_t al) noexcept
+{
+	allocation_count.fetch_add(1, memory_order_relaxed);
+	return _aligned_malloc(n ? n : 1, static_cast<size_t>(al));
+}
+
+void* operator new(size_t n)
+{
+	if (void* p{ counted_alloc(n) })
+		return p;
+	throw bad_alloc{};
+}
+
+void* operator new[](size_t n) { return operator new(n); }
+void* operator new(size_t n, const nothrow_t&) noexcept { return counted_alloc(n); }
+void* operator new[](size_t n, const nothrow_t&) noexcept { return counted_alloc(n); }
+
+void* operator new(size_t n, align_val_t al)
+{
+	if (void* p{ counted_alloc(n, al) })
+		return p;
+	throw bad_alloc{};
+}
+
+void* operator new[](size_t n, align_val_t al) { return operator new(n, al); }
+void* operator new(size_t n, align_val_t al, const nothrow_t&) noexcept { return counted_alloc(n, al); }
+void* operator new[](size_t n, align_val_t al, const nothrow_t&) noexcept { return counted_alloc(n, al); }
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, const nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const nothrow_t&) noexcept { free(p); }
+
+void operator delete(void* p, align_val_t) noexcept { _aligned_free(p); }
+void operator delete[](void* p, align_val_t) noexcept { _aligned_free(p); }
+void operator delete(void* p, size_t, align_val_t) noexcept { _aligned_free(p); }
+void operator delete[](void* p, size_t, align_val_t) noexcept { _aligned_free(p); }
+void operator delete(void* p, align_val_t, const nothrow_t&) noexcept { _aligned_free(p); }
+void operator delete[](void* p, align_val_t, const nothrow_t&) noexcept { _aligned_free(p); }
+
+namespace NetworkingTest
+{
+	struct EchoHandler
+	{
+		io_context* ctx;
+		size_t* remaining;
+		char payload[32];
+
+		void operator()()
+		{
+			if (--*remaining)
+				ctx->get_executor().post(*this, allocator<void>{});
+		}
+	};
+
+	// Both peers stop after the same number of round trips: the one that sends first
+	// counts its receives, the other counts its sends.
+	struct EchoPeer
+	{
+		tcp::socket* self;
+		size_t remaining;
+		bool initiator;
+		array<char, 32> data;
+
+		void receive()
+		{
+			self->async_receive(buffer(data), [this](const error_code& ec, size_t n) {
+				if (!ec && !(initiator && !--remaining))
+					send(n);
+			});
+		}
+
+		void send(size_t n)
+		{
+			self->async_send(buffer(data, n), [this](const error_code& ec, size_t) {
+				if (!ec && !(!initiator && !--remaining))
+					receive();
+			});
+		}
+	};
+
+	TEST_CLASS(IoContextTest)
+	{
+	public:
+		TEST_METHOD(RecyclingTest)
+		{
+			io_context ctx{};
+			size_t remaining{ 16 };
+			ctx.get_executor().post(EchoHandler{ &ctx, &remaining }, allocator<void>{});
+			Assert::AreEqual(size_t(16), ctx.run());
+
+			ctx.restart();
+			remaining = 1000000;
+			size_t before{ allocation_count.load() };
+			ctx.get_executor().post(EchoHandler{ &ctx, &remaining }, allocator<void>{});
+			Assert::AreEqual(size_t(1000000), ctx.run());
+			Assert::AreEqual(size_t(0), allocation_count.load() - before);
+		}
+
+		TEST_METHOD(SocketRecyclingTest)
+		{
+			io_context ctx{ 1 };
+			tcp::acceptor acceptor{ ctx, tcp::endpoint{ address_v4::loopback(), 0 } };
+			tcp::socket client{ ctx };
+			client.connect(acceptor.local_endpoint());
+			tcp::socket server{ acceptor.accept() };
+			client.set_option(tcp::no_delay{ true });
+			server.set_option(tcp::no_delay{ true });
+
+			EchoPeer ping{ &client, 16, true }, pong{ &server, 16, false };
+			pong.receive();
+			ping.send(ping.data.size());
+			ctx.run();
+			Assert::AreEqual(size_t(0), ping.remaining);
+			Assert::AreEqual(size_t(0), pong.remaining);
+
+			constexpr size_t count{ 100000 };
+			ctx.restart();
+			ping.remaining = count;
+			pong.remaining = count;
+			size_t before{ allocation_count.load() };
+			pong.receive();
+			ping.send(ping.data.size());
+			ctx.run();
+			Assert::AreEqual(size_t(0), allocation_count.load() - before);
+			Assert::AreEqual(size_t(0), ping.remaining);
+		}
+
+		TEST_METHOD(ThroughputTest)
+		{
+			constexpr size_t count{ 1000000 };
+			for (size_t threads{ 1 }; threads <= 32; threads *= 2)
+			{
+				io_context ctx{ static_cast<int>(threads) };
+				atomic<size_t> executed{ 0 };
+				auto ex{ ctx.get_executor() };
+				for (size_t i{ 0 }; i < count; ++i)
+				{
+					ex.post([&executed, ex] { executed.fetch_add(ex.running_in_this_thread() ? 1 : 0, memory_order_relaxed); }, allocator<void>{});
+				}
+				atomic<size_t> total{ 0 };
+				vector<thread> pool;
+				auto start{ chrono::steady_clock::now() };
+				for (size_t i{ 0 }; i < threads; ++i)
+					pool.emplace_back([&ctx, &total] { total.fetch_add(ctx.run(), memory_order_relaxed); });
+				for (auto& t : pool)
+					t.join();
+				chrono::duration<double> elapsed{ chrono::steady_clock::now() - start };
+				Assert::AreEqual(count, total.load());
+				Assert::AreEqual(count, executed.load());
+				Logger::WriteMessage((to_string(threads) + " threads: " + to_string(static_cast<size_t>(count / elapsed.count())) + " handlers/s\n").c_str());
+			}
+		}
+
+		TEST_METHOD(StrandTest)
+		{
+			constexpr size_t count{ 100000 };
+			io_context ctx{ 4 };
+			strand<io_context::executor_type> s{ ctx.get_executor() };
+			atomic<int> inside{ 0 };
+			atomic<bool> overlapped{ false };
+			vector<size_t> order;
+			order.reserve(count);
+			for (size_t i{ 0 }; i < count; ++i)
+			{
+				auto f{ [&, i] {
+					if (inside.fetch_add(1) != 0 || !s.running_in_this_thread())
+						overlapped = true;
+					order.push_back(i);
+					inside.fetch_sub(1);
+				} };
+				s.post(move(f), allocator<void>{});
+			}
+			Assert::IsFalse(s.running_in_this_thread());
+			vector<thread> pool;
+			for (size_t i{ 0 }; i < 4; ++i)
+				pool.emplace_back([&ctx] { ctx.run(); });
+			for (auto& t : pool)
+				t.join();
+			Assert::IsFalse(overlapped.load());
+			Assert::AreEqual(count, order.size());
+			for (size_t i{ 0 }; i < count; ++i)
+				Assert::AreEqual(i, order[i]);
+		}
+
+		TEST_METHOD(StrandThrowTest)
+		{
+			io_context ctx;
+			strand<io_context::executor_type> s{ ctx.get_executor() };
+			bool after{ false };
+			s.post([] { throw runtime_error{ "handler" }; }, allocator<void>{});
+			s.post([&after] { after = true; }, allocator<void>{});
+			// The strand is reposted before the exception leaves run(), so the next handler still runs.
+			Assert::ExpectException<runtime_error>([&ctx] { ctx.run(); });
+			Assert::IsFalse(after);
+			ctx.run();
+			Assert::IsTrue(after);
+		}
+	};
+}
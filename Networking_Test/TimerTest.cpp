@@ -0,0 +1,163 @@
+#include "pch.h"
+
+#include <atomic>
+#include <chrono>
+#include <experimental/timer>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace std;
+using namespace std::experimental::net;
+
+namespace NetworkingTest
+{
+	TEST_CLASS(TimerTest)
+	{
+	public:
+		TEST_METHOD(AsyncWaitTest)
+		{
+			io_context ctx{};
+			vector<int> order;
+			steady_timer a{ ctx, chrono::milliseconds(60) }, b{ ctx, chrono::milliseconds(20) }, c{ ctx, chrono::milliseconds(40) };
+			a.async_wait([&order](error_code ec) { order.push_back(ec ? -1 : 3); });
+			b.async_wait([&order](error_code ec) { order.push_back(ec ? -1 : 1); });
+			c.async_wait([&order](error_code ec) { order.push_back(ec ? -1 : 2); });
+			auto start{ chrono::steady_clock::now() };
+			Assert::AreEqual(size_t(3), ctx.run());
+			Assert::IsTrue(chrono::steady_clock::now() - start >= chrono::milliseconds(60));
+			Assert::IsTrue(order == vector<int>{ 1, 2, 3 });
+		}
+
+		TEST_METHOD(CancelTest)
+		{
+			io_context ctx{};
+			steady_timer t{ ctx, chrono::hours(1) };
+			size_t aborted{ 0 };
+			t.async_wait([&aborted](error_code ec) { if (ec == errc::operation_canceled) ++aborted; });
+			t.async_wait([&aborted](error_code ec) { if (ec == errc::operation_canceled) ++aborted; });
+			Assert::AreEqual(size_t(1), t.cancel_one());
+			Assert::AreEqual(size_t(1), t.cancel());
+			Assert::AreEqual(size_t(0), t.cancel());
+			Assert::AreEqual(size_t(2), ctx.run());
+			Assert::AreEqual(size_t(2), aborted);
+		}
+
+		TEST_METHOD(ManyTimersTest)
+		{
+			constexpr size_t count{ 1000000 };
+			io_context ctx{};
+			mt19937 rng{};
+			vector<unique_ptr<steady_timer>> timers;
+			timers.reserve(count);
+			size_t fired{ 0 }, aborted{ 0 };
+			auto start{ chrono::steady_clock::now() };
+			for (size_t i{ 0 }; i < count; ++i)
+			{
+				timers.push_back(make_unique<steady_timer>(ctx, start + chrono::milliseconds(rng() % 100)));
+				timers.back()->async_wait([&fired, &aborted](error_code ec) { ++(ec ? aborted : fired); });
+			}
+			for (size_t i{ 0 }; i < count; i += 2)
+				timers[i]->cancel();
+			Assert::AreEqual(count, ctx.run());
+			Assert::AreEqual(count / 2, fired);
+			Assert::AreEqual(count / 2, aborted);
+			double elapsed{ chrono::duration<double>(chrono::steady_clock::now() - start).count() };
+			Logger::WriteMessage(("timers: " + to_string(count) + " in " + to_string(elapsed) + " s\n").c_str());
+		}
+
+		TEST_METHOD(CoarseTimerTest)
+		{
+			io_context ctx{};
+			coarse_steady_timer t{ ctx, chrono::milliseconds(30) };
+			size_t fired{ 0 }, aborted{ 0 };
+			t.async_wait([&fired, &aborted](error_code ec) { ++(ec ? aborted : fired); });
+			Assert::AreEqual(size_t(0), t.expires_after(chrono::milliseconds(120)));
+			auto start{ chrono::steady_clock::now() };
+			Assert::AreEqual(size_t(1), ctx.run());
+			Assert::IsTrue(chrono::steady_clock::now() - start >= chrono::milliseconds(110));
+			Assert::AreEqual(size_t(1), fired);
+
+			ctx.restart();
+			t.expires_after(chrono::hours(1));
+			t.async_wait([&fired, &aborted](error_code ec) { ++(ec ? aborted : fired); });
+			Assert::AreEqual(size_t(1), t.expires_after(chrono::milliseconds(10)));
+			Assert::AreEqual(size_t(1), ctx.run());
+			Assert::AreEqual(size_t(1), aborted);
+		}
+
+		TEST_METHOD(IdleWakeTest)
+		{
+			io_context ctx{};
+			coarse_steady_timer t{ ctx, chrono::milliseconds(10) };
+			t.async_wait([](error_code) {});
+			Assert::AreEqual(size_t(1), ctx.run());
+
+			// A thread blocked without any timer pending has no timeout, so scheduling one must wake it.
+			ctx.restart();
+			auto guard{ make_work_guard(ctx) };
+			atomic<bool> fired{ false };
+			thread runner{ [&ctx] { ctx.run(); } };
+			this_thread::sleep_for(chrono::milliseconds(50));
+			t.expires_after(chrono::milliseconds(30));
+			t.async_wait([&fired](error_code ec) { fired = !ec; });
+			auto start{ chrono::steady_clock::now() };
+			while (!fired && chrono::steady_clock::now() - start < chrono::seconds(5))
+				this_thread::sleep_for(chrono::milliseconds(1));
+			ctx.stop();
+			runner.join();
+			Assert::IsTrue(fired.load());
+		}
+
+		TEST_METHOD(CoarseRearmTest)
+		{
+			constexpr size_t count{ 1000000 };
+			constexpr size_t rounds{ 10 };
+			io_context ctx{};
+			vector<unique_ptr<coarse_steady_timer>> timers;
+			timers.reserve(count);
+			size_t fired{ 0 };
+			for (size_t i{ 0 }; i < count; ++i)
+			{
+				timers.push_back(make_unique<coarse_steady_timer>(ctx, chrono::milliseconds(50)));
+				timers.back()->async_wait([&fired](error_code ec) { if (!ec) ++fired; });
+			}
+			auto start{ chrono::steady_clock::now() };
+			for (size_t r{ 0 }; r < rounds; ++r)
+			{
+				for (auto& t : timers)
+					t->expires_after(chrono::milliseconds(100));
+			}
+			double elapsed{ chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() };
+			Assert::AreEqual(count, ctx.run());
+			Assert::AreEqual(count, fired);
+			Logger::WriteMessage(("re-arm: " + to_string(elapsed / (count * rounds)) + " ns\n").c_str());
+		}
+
+		TEST_METHOD(CoarseRearmDueTest)
+		{
+			constexpr size_t count{ 10 };
+			io_context ctx{};
+			vector<unique_ptr<coarse_steady_timer>> timers;
+			size_t fired{ 0 }, canceled{ 0 };
+			for (size_t i{ 0 }; i < count; ++i)
+			{
+				timers.push_back(make_unique<coarse_steady_timer>(ctx, chrono::milliseconds(10)));
+				timers.back()->async_wait([&fired, &canceled](error_code ec) { ++(ec == errc::operation_canceled ? canceled : fired); });
+			}
+			this_thread::sleep_for(chrono::milliseconds(50));
+			// Completes one wait and leaves the other timers in the due list, still holding their waits.
+			Assert::AreEqual(size_t(1), ctx.run_one());
+			size_t reset{ 0 };
+			for (auto& t : timers)
+				reset += t->expires_after(chrono::hours(1));
+			Assert::AreEqual(count - 1, reset);
+			Assert::AreEqual(count - 1, ctx.run());
+			Assert::AreEqual(size_t(1), fired);
+			Assert::AreEqual(count - 1, canceled);
+		}
+	};
+}
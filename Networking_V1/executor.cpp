@@ -49,71 +49,375 @@ void execution_context::_Service_registry::notify_fork(fork_event fork_ev)
     }
 }
 
-_Thread_pool::_Thread_pool() : stopped_(true)
+class _Thread_pool::_Worker
 {
-    threads_ = deque<thread>(thread::hardware_concurrency());
+public:
+    _Worker(_Thread_pool& pool, size_t index) : pool(&pool), index(index), top_(0), bottom_(0), array_(new _Array{ 256 }) {}
+    ~_Worker() { delete array_.load(memory_order_relaxed); }
+
+    _Worker(const _Worker&) = delete;
+    _Worker& operator=(const _Worker&) = delete;
+
+    void push(_Handler_node* job)
+    {
+        int64_t b{ bottom_.load(memory_order_relaxed) };
+        int64_t t{ top_.load(memory_order_acquire) };
+        _Array* a{ array_.load(memory_order_relaxed) };
+        if (b - t > static_cast<int64_t>(a->mask))
+        {
+            _Array* bigger{ a->grow(t, b) };
+            retired_.emplace_back(a);
+            array_.store(bigger, memory_order_release);
+            a = bigger;
+        }
+        a->put(b, job);
+        bottom_.store(b + 1, memory_order_release);
+    }
+
+    _Handler_node* pop()
+    {
+        // Only the owner moves bottom and top never goes back, so an empty deque is seen without the fence.
+        if (bottom_.load(memory_order_relaxed) <= top_.load(memory_order_relaxed))
+            return nullptr;
+        int64_t b{ bottom_.load(memory_order_relaxed) - 1 };
+        _Array* a{ array_.load(memory_order_relaxed) };
+        bottom_.store(b, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t t{ top_.load(memory_order_relaxed) };
+        if (t > b)
+        {
+            bottom_.store(b + 1, memory_order_relaxed);
+            return nullptr;
+        }
+        _Handler_node* job{ a->get(b) };
+        if (t == b)
+        {
+            if (!top_.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+                job = nullptr;
+            bottom_.store(b + 1, memory_order_relaxed);
+        }
+        return job;
+    }
+
+    _Handler_node* steal()
+    {
+        int64_t t{ top_.load(memory_order_acquire) };
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t b{ bottom_.load(memory_order_acquire) };
+        if (t >= b)
+            return nullptr;
+        _Array* a{ array_.load(memory_order_acquire) };
+        _Handler_node* job{ a->get(t) };
+        if (!top_.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+            return nullptr;
+        return job;
+    }
+
+    bool empty() const noexcept { return bottom_.load(memory_order_acquire) <= top_.load(memory_order_acquire); }
+
+    _Thread_pool* pool;
+    size_t index;
+
+private:
+    struct _Array
+    {
+        explicit _Array(size_t capacity) : mask(capacity - 1), items(new atomic<_Handler_node*>[capacity]) {}
+
+        _Handler_node* get(int64_t i) const noexcept { return items[static_cast<size_t>(i) & mask].load(memory_order_relaxed); }
+        void put(int64_t i, _Handler_node* job) noexcept { items[static_cast<size_t>(i) & mask].store(job, memory_order_relaxed); }
+        _Array* grow(int64_t t, int64_t b) const
+        {
+            _Array* a{ new _Array{ (mask + 1) * 2 } };
+            for (int64_t i{ t }; i < b; ++i)
+                a->put(i, get(i));
+            return a;
+        }
+
+        size_t mask;
+        unique_ptr<atomic<_Handler_node*>[]> items;
+    };
+
+    atomic<int64_t> top_;
+    atomic<int64_t> bottom_;
+    atomic<_Array*> array_;
+    // Thieves may still be reading a replaced array, so it lives as long as the worker.
+    vector<unique_ptr<_Array>> retired_;
+};
+
+// A segment of the injection queue. Handlers are stored in place, so that a post from outside of the pool
+// allocates once for a whole block rather than once for every handler.
+class _Thread_pool::_Inject_block
+{
+public:
+    _Inject_block() noexcept : next(nullptr), head_(0), tail_(0) {}
+    ~_Inject_block()
+    {
+        while (!empty())
+            pop();
+    }
+
+    bool empty() const noexcept { return head_ == tail_; }
+    bool full() const noexcept { return tail_ == _Capacity; }
+    bool drained() const noexcept { return head_ == _Capacity; }
+
+    void push(_Executor_function&& f) noexcept
+    {
+        ::new (static_cast<void*>(&slots_[tail_++])) _Executor_function(move(f));
+    }
+
+    _Executor_function pop() noexcept
+    {
+        _Executor_function* p{ reinterpret_cast<_Executor_function*>(&slots_[head_++]) };
+        _Executor_function f{ move(*p) };
+        p->~_Executor_function();
+        return f;
+    }
+
+    void reset() noexcept
+    {
+        next = nullptr;
+        head_ = 0;
+        tail_ = 0;
+    }
+
+    _Inject_block* next;
+
+private:
+    static constexpr size_t _Capacity{ 64 };
+
+    size_t head_;
+    size_t tail_;
+    aligned_storage_t<sizeof(_Executor_function), alignof(_Executor_function)> slots_[_Capacity];
+};
+
+// A handler deferred from outside of the pool goes through the injection queue as well.
+struct _Thread_pool::_Node_function
+{
+    _Node_function(_Handler_node* job) noexcept : job(job) {}
+    _Node_function(_Node_function&& other) noexcept : job(exchange(other.job, nullptr)) {}
+    ~_Node_function()
+    {
+        if (job)
+            job->invoke(job, false);
+    }
+
+    void operator()()
+    {
+        _Handler_node* j{ exchange(job, nullptr) };
+        j->invoke(j, true);
+    }
+
+    _Handler_node* job;
+};
+
+thread_local _Thread_pool::_Worker* _Thread_pool::current_{ nullptr };
+
+_Thread_pool::_Thread_pool() : inject_head_(nullptr), inject_tail_(nullptr), inject_spare_(nullptr), injected_(0), sleeping_(0), wakeups_(0), stopped_(false)
+{
+    size_t n{ max(thread::hardware_concurrency(), 1u) };
+    for (size_t i{ 0 }; i < n; ++i)
+        workers_.push_back(make_unique<_Worker>(*this, i));
+}
+
+_Thread_pool::~_Thread_pool()
+{
+    stop();
+    join();
+    for (auto& w : workers_)
+    {
+        while (_Handler_node* job{ w->pop() })
+            job->invoke(job, false);
+    }
+    while (inject_head_)
+        delete exchange(inject_head_, inject_head_->next);
+    delete inject_spare_;
 }
 
 void _Thread_pool::start()
 {
-    for (thread& t : threads_)
+    for (auto& w : workers_)
+    {
+        threads_.emplace_back([this, &w = *w]() { do_job(w); });
+    }
+}
+
+void _Thread_pool::post(_Executor_function&& f)
+{
     {
-        t = thread([this]() { do_job(); });
+        lock_guard<mutex> lock{ inject_mutex_ };
+        if (!inject_tail_ || inject_tail_->full())
+        {
+            _Inject_block* b{ inject_spare_ ? exchange(inject_spare_, nullptr) : new _Inject_block{} };
+            if (inject_tail_)
+                inject_tail_->next = b;
+            else
+                inject_head_ = b;
+            inject_tail_ = b;
+        }
+        inject_tail_->push(move(f));
+        injected_.fetch_add(1, memory_order_seq_cst);
     }
+    _Wake();
 }
 
-void _Thread_pool::post(function<void()>&& f)
+void _Thread_pool::defer(_Handler_node* job)
 {
+    if (current_ && current_->pool == this)
     {
-        lock_guard<mutex> lock{ jobs_mutex_ };
-        jobs_.emplace_back(move(f));
+        current_->push(job);
+        // The push only releases bottom, and a parking worker must not miss it.
+        atomic_thread_fence(memory_order_seq_cst);
+        _Wake();
     }
-    cond_.notify_one();
+    else
+        post(_Executor_function{ _Node_function{ job }, allocator<void>{} });
 }
 
 void _Thread_pool::stop()
 {
-    if (!stopped_)
+    if (!stopped_.exchange(true, memory_order_acq_rel))
     {
-        stopped_ = true;
-        cond_.notify_all();
+        lock_guard<mutex> lock{ park_mutex_ };
+        park_cond_.notify_all();
     }
 }
 
 void _Thread_pool::join()
 {
-    if (!stopped_)
+    for (thread& t : threads_)
     {
-        for (thread& t : threads_)
-        {
+        if (t.joinable() && t.get_id() != this_thread::get_id())
             t.join();
+    }
+}
+
+void _Thread_pool::do_job(_Worker& w)
+{
+    current_ = &w;
+    while (!stopped())
+    {
+        if (_Run_next(w))
+            continue;
+        unique_lock<mutex> lock{ park_mutex_ };
+        sleeping_.fetch_add(1, memory_order_seq_cst);
+        if (stopped() || _Has_work())
+        {
+            sleeping_.fetch_sub(1, memory_order_relaxed);
+            continue;
         }
+        park_cond_.wait(lock, [this] { return wakeups_ || stopped(); });
+        // A worker woken by _Wake has already been taken off the sleeping count.
+        if (wakeups_)
+            --wakeups_;
+        else
+            sleeping_.fetch_sub(1, memory_order_relaxed);
     }
+    current_ = nullptr;
 }
 
-void _Thread_pool::do_job()
+bool _Thread_pool::_Run_next(_Worker& w)
 {
-    while (true)
+    if (_Handler_node* job{ w.pop() })
+    {
+        job->invoke(job, true);
+        return true;
+    }
+    if (_Run_injected())
+        return true;
+    size_t n{ workers_.size() };
+    for (size_t i{ 1 }; i < n; ++i)
     {
-        if (jobs_.empty())
+        if (_Handler_node* job{ workers_[(w.index + i) % n]->steal() })
         {
-            unique_lock<mutex> lock{ cond_mutex_ };
-            cond_.wait(lock);
+            job->invoke(job, true);
+            return true;
         }
-        if (stopped_)
-            break;
-        function<void()> f;
+    }
+    return false;
+}
+
+bool _Thread_pool::_Run_injected()
+{
+    if (!injected_.load(memory_order_acquire))
+        return false;
+    unique_lock<mutex> lock{ inject_mutex_ };
+    if (!inject_head_ || inject_head_->empty())
+        return false;
+    _Executor_function f{ inject_head_->pop() };
+    injected_.store(injected_.load(memory_order_relaxed) - 1, memory_order_relaxed);
+    if (inject_head_->drained())
+    {
+        _Inject_block* b{ exchange(inject_head_, inject_head_->next) };
+        if (!inject_head_)
+            inject_tail_ = nullptr;
+        if (inject_spare_)
+            delete b;
+        else
         {
-            lock_guard<mutex> lock{ jobs_mutex_ };
-            if (!jobs_.empty())
-            {
-                f = move(jobs_.front());
-                jobs_.pop_front();
-            }
+            b->reset();
+            inject_spare_ = b;
         }
-        if (f)
-            f();
     }
+    lock.unlock();
+    f();
+    return true;
+}
+
+bool _Thread_pool::_Has_work() const noexcept
+{
+    if (injected_.load(memory_order_seq_cst))
+        return true;
+    return any_of(workers_.begin(), workers_.end(), [](const unique_ptr<_Worker>& w) { return !w->empty(); });
+}
+
+void _Thread_pool::_Wake()
+{
+    if (sleeping_.load(memory_order_seq_cst))
+    {
+        // The woken worker is claimed here, so that posts made before it runs do not notify again.
+        lock_guard<mutex> lock{ park_mutex_ };
+        if (sleeping_.load(memory_order_relaxed))
+        {
+            sleeping_.fetch_sub(1, memory_order_relaxed);
+            ++wakeups_;
+            park_cond_.notify_one();
+        }
+    }
+}
+
+thread_local exception_ptr _Spawned_exception::pending_{};
+
+void _Spawned_exception::_Store(exception_ptr e) noexcept
+{
+    pending_ = move(e);
+}
+
+void _Spawned_exception::_Rethrow()
+{
+    if (pending_)
+        rethrow_exception(exchange(pending_, nullptr));
+}
+
+thread_local const _Strand_call_stack* _Strand_call_stack::top_{ nullptr };
+
+_Strand_call_stack::_Strand_call_stack(const _Strand_impl* impl) noexcept : impl_(impl), next_(top_)
+{
+    top_ = this;
+}
+
+_Strand_call_stack::~_Strand_call_stack()
+{
+    top_ = next_;
+}
+
+bool _Strand_call_stack::contains(const _Strand_impl* impl) noexcept
+{
+    for (const _Strand_call_stack* c{ top_ }; c; c = c->next_)
+    {
+        if (c->impl_ == impl)
+            return true;
+    }
+    return false;
 }
 
 system_context::system_context()
@@ -6,43 +6,310 @@ inline namespace v1
 {
 namespace ip
 {
-address_v4 make_address_v4(const char* str, error_code& ec) noexcept
+// The parsers and formatters below are hand-written so that they neither allocate nor go through the
+// wide-char WinSock conversions. The accepted forms match inet_pton, plus a numeric %scope on IPv6.
+
+static bool _Parse_v4(const char* p, const char* end, unsigned char* bytes) noexcept
+{
+    for (int i = 0; i < 4; i++)
+    {
+        if (i > 0)
+        {
+            if (p == end || *p != '.')
+                return false;
+            ++p;
+        }
+        const char* first{ p };
+        unsigned value{ 0 };
+        while (p != end && p - first < 3 && static_cast<unsigned>(*p - '0') < 10)
+            value = value * 10 + static_cast<unsigned>(*p++ - '0');
+        // No empty parts, nothing above 255, and no leading zeros that could be read as octal.
+        if (p == first || value > 255 || (*first == '0' && p - first > 1))
+            return false;
+        bytes[i] = static_cast<unsigned char>(value);
+    }
+    return p == end;
+}
+
+static int _Hex_digit(char c) noexcept
+{
+    if (static_cast<unsigned>(c - '0') < 10)
+        return c - '0';
+    c |= 0x20;
+    if (static_cast<unsigned>(c - 'a') < 6)
+        return c - 'a' + 10;
+    return -1;
+}
+
+static bool _Parse_uint(const char* p, const char* end, unsigned long long max, unsigned long long& value) noexcept
+{
+    if (p == end)
+        return false;
+    value = 0;
+    for (; p != end; ++p)
+    {
+        if (static_cast<unsigned>(*p - '0') >= 10)
+            return false;
+        value = value * 10 + static_cast<unsigned>(*p - '0');
+        if (value > max)
+            return false;
+    }
+    return true;
+}
+
+static bool _Parse_v6(const char* p, const char* end, unsigned char* bytes, scope_id_type& scope) noexcept
+{
+    scope = 0;
+    const char* percent{ static_cast<const char*>(memchr(p, '%', static_cast<size_t>(end - p))) };
+    if (percent)
+    {
+        unsigned long long value;
+        if (!_Parse_uint(percent + 1, end, 0xFFFFFFFF, value))
+            return false;
+        scope = static_cast<scope_id_type>(value);
+        end = percent;
+    }
+    uint16_t words[8]{};
+    int count{ 0 };
+    // The index of the word where "::" stands, if any.
+    int gap{ -1 };
+    if (p != end && *p == ':')
+    {
+        if (end - p < 2 || p[1] != ':')
+            return false;
+        p += 2;
+        gap = 0;
+    }
+    while (p != end)
+    {
+        const char* first{ p };
+        unsigned value{ 0 };
+        int digit;
+        while (p != end && p - first < 4 && (digit = _Hex_digit(*p)) >= 0)
+        {
+            value = (value << 4) | static_cast<unsigned>(digit);
+            ++p;
+        }
+        if (p == first)
+            return false;
+        if (p != end && *p == '.')
+        {
+            // An IPv4 address in dotted form ends the string and takes the last two words.
+            unsigned char v4[4];
+            if (count > 6 || !_Parse_v4(first, end, v4))
+                return false;
+            words[count++] = static_cast<uint16_t>((v4[0] << 8) | v4[1]);
+            words[count++] = static_cast<uint16_t>((v4[2] << 8) | v4[3]);
+            p = end;
+            break;
+        }
+        if (count == 8)
+            return false;
+        words[count++] = static_cast<uint16_t>(value);
+        if (p == end)
+            break;
+        if (*p++ != ':' || p == end)
+            return false;
+        if (*p == ':')
+        {
+            if (gap >= 0)
+                return false;
+            gap = count;
+            ++p;
+        }
+    }
+    if (gap >= 0)
+    {
+        // "::" stands for at least one zero word.
+        if (count == 8)
+            return false;
+        int tail{ count - gap };
+        for (int i = 0; i < tail; i++)
+            words[7 - i] = words[count - 1 - i];
+        for (int i = gap; i < 8 - tail; i++)
+            words[i] = 0;
+    }
+    else if (count != 8)
+        return false;
+    for (int i = 0; i < 8; i++)
+    {
+        bytes[2 * i] = static_cast<unsigned char>(words[i] >> 8);
+        bytes[2 * i + 1] = static_cast<unsigned char>(words[i]);
+    }
+    return true;
+}
+
+address_v4 make_address_v4(string_view str, error_code& ec) noexcept
 {
     ec = error_code{};
     address_v4::bytes_type bytes;
-    int r{ ::inet_pton(AF_INET, str, bytes.data()) };
-    if (r != 1)
+    if (!_Parse_v4(str.data(), str.data() + str.size(), bytes.data()))
+    {
         ec = make_error_code(errc::invalid_argument);
+        return address_v4{};
+    }
     return address_v4{ bytes };
 }
 
-address_v6 make_address_v6(const char* str, error_code& ec) noexcept
+address_v6 make_address_v6(string_view str, error_code& ec) noexcept
 {
     ec = error_code{};
-    sockaddr_in6 s{};
-    int size = sizeof(sockaddr_in6);
-    size_t len = strlen(str);
-    wstring widestr(len, L'\0');
-    ::MultiByteToWideChar(CP_ACP, 0, str, -1, widestr.data(), (int)(len + 1));
-    int r{ ::WSAStringToAddressW(const_cast<wchar_t*>(widestr.data()), 6, nullptr, (LPSOCKADDR)&s, &size) };
-    if (r != 0)
+    address_v6::bytes_type bytes;
+    scope_id_type scope;
+    if (!_Parse_v6(str.data(), str.data() + str.size(), bytes.data(), scope))
+    {
         ec = make_error_code(errc::invalid_argument);
-    return address_v6{ s.sin6_addr, s.sin6_scope_id };
+        return address_v6{};
+    }
+    return address_v6{ bytes, scope };
 }
 
-address make_address(const char* str, error_code& ec) noexcept
+address make_address(string_view str, error_code& ec) noexcept
 {
-    address a{};
-    address_v6 v6a{ make_address_v6(str, ec) };
-    if (!ec)
-        a = v6a;
-    else
+    // The first separator tells the family: an IPv6 address has a colon before any dot.
+    for (char c : str)
+    {
+        if (c == ':')
+            return make_address_v6(str, ec);
+        if (c == '.')
+            return make_address_v4(str, ec);
+    }
+    ec = make_error_code(errc::invalid_argument);
+    return address{};
+}
+
+static char* _Format_uint(char* p, uint32_t value) noexcept
+{
+    char digits[10];
+    int n{ 0 };
+    do
     {
-        address_v4 v4a{ make_address_v4(str, ec) };
-        if (!ec)
-            a = v4a;
+        digits[n++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value);
+    while (n)
+        *p++ = digits[--n];
+    return p;
+}
+
+static char* _Format_v4(char* p, const unsigned char* bytes) noexcept
+{
+    for (int i = 0; i < 4; i++)
+    {
+        if (i > 0)
+            *p++ = '.';
+        p = _Format_uint(p, bytes[i]);
     }
-    return a;
+    return p;
+}
+
+static char* _Format_v6(char* p, const address_v6& addr) noexcept
+{
+    static constexpr char hex[]{ "0123456789abcdef" };
+    const address_v6::bytes_type bytes{ addr.to_bytes() };
+    uint16_t words[8];
+    for (int i = 0; i < 8; i++)
+        words[i] = static_cast<uint16_t>((bytes[2 * i] << 8) | bytes[2 * i + 1]);
+    // The first longest run of two or more zero words becomes "::", as in RFC 5952.
+    int gap{ -1 }, gap_len{ 1 };
+    for (int i = 0; i < 8;)
+    {
+        if (words[i])
+        {
+            ++i;
+            continue;
+        }
+        int j{ i };
+        while (j < 8 && !words[j])
+            ++j;
+        if (j - i > gap_len)
+        {
+            gap = i;
+            gap_len = j - i;
+        }
+        i = j;
+    }
+    if (gap < 0)
+        gap_len = 0;
+    // IPv4-compatible and mapped addresses end in dotted form, as inet_ntop writes them.
+    const bool dotted{ gap == 0 && (gap_len == 6 || (gap_len == 5 && words[5] == 0xFFFF)) };
+    const int count{ dotted ? 6 : 8 };
+    for (int i = 0; i < count; i++)
+    {
+        if (i >= gap && i < gap + gap_len)
+        {
+            if (i == gap)
+                *p++ = ':';
+            continue;
+        }
+        if (i > 0)
+            *p++ = ':';
+        bool leading{ true };
+        for (int shift = 12; shift >= 0; shift -= 4)
+        {
+            unsigned digit{ (words[i] >> shift) & 0xFu };
+            if (leading && digit == 0 && shift > 0)
+                continue;
+            leading = false;
+            *p++ = hex[digit];
+        }
+    }
+    if (gap >= 0 && gap + gap_len == count)
+        *p++ = ':';
+    if (dotted)
+    {
+        if (gap + gap_len != count)
+            *p++ = ':';
+        p = _Format_v4(p, bytes.data() + 12);
+    }
+    if (addr.scope_id())
+    {
+        *p++ = '%';
+        p = _Format_uint(p, addr.scope_id());
+    }
+    return p;
+}
+
+static to_chars_result _Copy_chars(char* first, char* last, const char* str, const char* str_end) noexcept
+{
+    size_t size{ static_cast<size_t>(str_end - str) };
+    if (static_cast<size_t>(last - first) < size)
+        return { last, errc::value_too_large };
+    memcpy(first, str, size);
+    return { first + size, errc{} };
+}
+
+to_chars_result to_chars(char* first, char* last, const address_v4& addr) noexcept
+{
+    char str[16];
+    return _Copy_chars(first, last, str, _Format_v4(str, addr.to_bytes().data()));
+}
+
+to_chars_result to_chars(char* first, char* last, const address_v6& addr) noexcept
+{
+    char str[64];
+    return _Copy_chars(first, last, str, _Format_v6(str, addr));
+}
+
+to_chars_result to_chars(char* first, char* last, const address& addr) noexcept
+{
+    return addr.is_v4() ? to_chars(first, last, addr.to_v4()) : to_chars(first, last, addr.to_v6());
+}
+
+to_chars_result to_chars(char* first, char* last, const network_v4& net) noexcept
+{
+    char str[20];
+    char* p{ _Format_v4(str, net.address().to_bytes().data()) };
+    *p++ = '/';
+    return _Copy_chars(first, last, str, _Format_uint(p, static_cast<uint32_t>(net.prefix_length())));
+}
+
+to_chars_result to_chars(char* first, char* last, const network_v6& net) noexcept
+{
+    char str[68];
+    char* p{ _Format_v6(str, net.address()) };
+    *p++ = '/';
+    return _Copy_chars(first, last, str, _Format_uint(p, static_cast<uint32_t>(net.prefix_length())));
 }
 
 basic_address_iterator<address_v4>& basic_address_iterator<address_v4>::operator++() noexcept
@@ -83,68 +350,327 @@ basic_address_iterator<address_v6>& basic_address_iterator<address_v6>::operator
     return *this;
 }
 
-network_v4 make_network_v4(const string& str, error_code& ec) noexcept
+template <class Network, class Make>
+static Network _Make_network(string_view str, int max_prefix_len, Make make, error_code& ec) noexcept
 {
     ec = error_code{};
-    auto pos{ str.find_first_of('/') };
-    if (pos == string::npos)
+    auto pos{ str.find('/') };
+    unsigned long long prefix_len;
+    if (pos == string_view::npos || !_Parse_uint(str.data() + pos + 1, str.data() + str.size(), static_cast<unsigned long long>(max_prefix_len), prefix_len))
     {
         ec = make_error_code(errc::invalid_argument);
-        return network_v4{};
+        return Network{};
     }
-    if (pos == str.size() - 1)
+    const auto addr{ make(str.substr(0, pos), ec) };
+    if (ec)
+        return Network{};
+    return Network{ addr, static_cast<int>(prefix_len) };
+}
+
+network_v4 make_network_v4(string_view str, error_code& ec) noexcept
+{
+    return _Make_network<network_v4>(str, 32, [](string_view s, error_code& ec) { return make_address_v4(s, ec); }, ec);
+}
+
+network_v6 make_network_v6(string_view str, error_code& ec) noexcept
+{
+    return _Make_network<network_v6>(str, 128, [](string_view s, error_code& ec) { return make_address_v6(s, ec); }, ec);
+}
+
+void _Prefix_trie::_Expand(_Slot* first, size_t count, int prefix_len, uint32_t value) noexcept
+{
+    for (_Slot* slot{ first }; slot != first + count; ++slot)
     {
-        ec = make_error_code(errc::invalid_argument);
-        return network_v4{};
+        // A longer prefix already expanded here keeps its slots.
+        if (!slot->value || slot->prefix_len <= prefix_len)
+        {
+            slot->value = value;
+            slot->prefix_len = prefix_len;
+        }
     }
-    auto end{ str.find_first_not_of("0123456789", pos + 1) };
-    if (end != string::npos)
+}
+
+void _Prefix_trie::_Insert(const unsigned char* key, int prefix_len, uint32_t value)
+{
+    if (root_.empty())
     {
-        ec = make_error_code(errc::invalid_argument);
-        return network_v4{};
+        root_.resize(size_t{ 1 } << 16);
+        nodes_.resize(256);
+    }
+    size_t index{ static_cast<size_t>((key[0] << 8) | key[1]) };
+    if (prefix_len <= 16)
+    {
+        size_t first{ prefix_len ? index & (~size_t{ 0 } << (16 - prefix_len)) & 0xFFFF : 0 };
+        _Expand(&root_[first], size_t{ 1 } << (16 - prefix_len), prefix_len, value);
+        return;
     }
-    const address_v4 addr{ make_address_v4(str.substr(0, pos), ec) };
+    // The slot of the path is held by index, as growing nodes_ moves its slots.
+    bool in_root{ true };
+    int depth{ 16 };
+    for (size_t i{ 2 };; ++i, depth += 8)
+    {
+        uint32_t child{ (in_root ? root_[index] : nodes_[index]).child };
+        if (!child)
+        {
+            child = static_cast<uint32_t>(nodes_.size());
+            nodes_.resize(nodes_.size() + 256);
+            (in_root ? root_[index] : nodes_[index]).child = child;
+        }
+        int stride{ prefix_len - depth };
+        if (stride <= 8)
+        {
+            size_t first{ static_cast<size_t>(key[i] & (0xFF << (8 - stride)) & 0xFF) };
+            _Expand(&nodes_[child + first], size_t{ 1 } << (8 - stride), prefix_len, value);
+            return;
+        }
+        index = child + key[i];
+        in_root = false;
+    }
+}
+
+void _Prefix_trie::_Clear() noexcept
+{
+    root_.clear();
+    root_.shrink_to_fit();
+    nodes_.clear();
+    nodes_.shrink_to_fit();
+}
+
+size_t _Resolver_key_hash::operator()(const _Resolver_key& key) const noexcept
+{
+    size_t h{ hash<string>{}(key.host) };
+    for (size_t v : { hash<string>{}(key.service), static_cast<size_t>(key.flags), static_cast<size_t>(key.family), static_cast<size_t>(key.type), static_cast<size_t>(key.protocol) })
+        h ^= v + 0x9E3779B9 + (h << 6) + (h >> 2);
+    return h;
+}
+
+static void _Append_address(vector<_Resolved_address>& addresses, int family, const ::sockaddr* addr)
+{
+    _Resolved_address a{};
+    if (family == AF_INET)
+        memcpy(&a.v4, addr, sizeof(a.v4));
+    else if (family == AF_INET6)
+        memcpy(&a.v6, addr, sizeof(a.v6));
+    else
+        return;
+    addresses.push_back(a);
+}
+
+_Resolver_lookup _Getaddrinfo(const _Resolver_key& key)
+{
+    ::addrinfo hints{};
+    hints.ai_flags = key.flags;
+    hints.ai_family = key.family;
+    hints.ai_socktype = key.type;
+    hints.ai_protocol = key.protocol;
+    ::addrinfo* result{ nullptr };
+    int r{ ::getaddrinfo(key.host.empty() ? nullptr : key.host.c_str(), key.service.empty() ? nullptr : key.service.c_str(), &hints, &result) };
+    _Resolver_lookup lookup{};
+    if (r != 0)
+    {
+        lookup.ec = make_error_code(static_cast<resolver_errc>(r));
+        return lookup;
+    }
+    for (::addrinfo* ptr{ result }; ptr; ptr = ptr->ai_next)
+        _Append_address(lookup.addresses, ptr->ai_family, ptr->ai_addr);
+    ::freeaddrinfo(result);
+    return lookup;
+}
+
+static wstring _Widen(const string& str)
+{
+    if (str.empty())
+        return {};
+    int len{ ::MultiByteToWideChar(CP_UTF8, 0, str.data(), static_cast<int>(str.size()), nullptr, 0) };
+    wstring widestr(len, L'\0');
+    ::MultiByteToWideChar(CP_UTF8, 0, str.data(), static_cast<int>(str.size()), widestr.data(), len);
+    return widestr;
+}
+
+_Resolve_operation::~_Resolve_operation()
+{
+    if (result_)
+        ::FreeAddrInfoExW(result_);
+}
+
+void _Resolve_operation::_Start(const _Resolver_key& key)
+{
+    host_ = _Widen(key.host);
+    service_ = _Widen(key.service);
+    ::ADDRINFOEXW hints{};
+    hints.ai_flags = key.flags;
+    hints.ai_family = key.family;
+    hints.ai_socktype = key.type;
+    hints.ai_protocol = key.protocol;
+    int r{ ::GetAddrInfoExW(host_.empty() ? nullptr : host_.c_str(), service_.empty() ? nullptr : service_.c_str(), NS_ALL, nullptr, &hints, &result_, nullptr, this, &_Routine, nullptr) };
+    if (r != WSA_IO_PENDING)
+        ctx_->_Post(this, r);
+}
+
+void CALLBACK _Resolve_operation::_Routine(DWORD err, DWORD, ::LPWSAOVERLAPPED overlapped)
+{
+    _Resolve_operation* op{ static_cast<_Resolve_operation*>(overlapped) };
+    // The context reads the status of a successful operation from here.
+    op->Internal = 0;
+    op->ctx_->_Post(op, err);
+}
+
+_Resolver_lookup _Resolve_operation::_Lookup(const error_code& ec)
+{
+    _Resolver_lookup lookup{};
     if (ec)
-        return network_v4{};
-    long prefix_len{ strtol(str.substr(pos + 1).c_str(), nullptr, 10) };
-    if (prefix_len < 0 || prefix_len > 32)
     {
-        ec = make_error_code(errc::invalid_argument);
-        return network_v4{};
+        lookup.ec = make_error_code(static_cast<resolver_errc>(ec.value()));
+        return lookup;
     }
-    return network_v4{ addr, (int)prefix_len };
+    for (::ADDRINFOEXW* ptr{ result_ }; ptr; ptr = ptr->ai_next)
+        _Append_address(lookup.addresses, ptr->ai_family, ptr->ai_addr);
+    return lookup;
 }
 
-network_v6 make_network_v6(const string& str, error_code& ec) noexcept
+resolver_cache::duration resolver_cache::ttl() const
 {
-    ec = error_code{};
-    auto pos{ str.find_first_of('/') };
-    if (pos == string::npos)
+    lock_guard<mutex> lock{ mtx_ };
+    return ttl_;
+}
+
+void resolver_cache::ttl(duration d)
+{
+    lock_guard<mutex> lock{ mtx_ };
+    ttl_ = d;
+}
+
+resolver_cache::duration resolver_cache::negative_ttl() const
+{
+    lock_guard<mutex> lock{ mtx_ };
+    return negative_ttl_;
+}
+
+void resolver_cache::negative_ttl(duration d)
+{
+    lock_guard<mutex> lock{ mtx_ };
+    negative_ttl_ = d;
+}
+
+size_t resolver_cache::size() const
+{
+    lock_guard<mutex> lock{ mtx_ };
+    return entries_.size();
+}
+
+void resolver_cache::clear()
+{
+    lock_guard<mutex> lock{ mtx_ };
+    // Queries still running keep their entries for the threads waiting on them.
+    for (auto it{ entries_.begin() }; it != entries_.end();)
     {
-        ec = make_error_code(errc::invalid_argument);
-        return network_v6{};
+        if (it->second.in_flight)
+        {
+            it->second.lookup.reset();
+            ++it;
+        }
+        else
+            it = entries_.erase(it);
+    }
+}
+
+resolver_cache::_Lookup_ptr resolver_cache::_Find(const _Resolver_key& key) const
+{
+    auto it{ entries_.find(key) };
+    if (it != entries_.end() && it->second.lookup && clock_type::now() < it->second.lookup->expiry)
+        return it->second.lookup;
+    return nullptr;
+}
+
+resolver_cache::_Lookup_ptr resolver_cache::_Resolve(const _Resolver_key& key, const function<_Resolver_lookup()>& lookup)
+{
+    {
+        unique_lock<mutex> lock{ mtx_ };
+        while (true)
+        {
+            if (_Lookup_ptr p{ _Find(key) })
+                return p;
+            _Entry& e{ entries_[key] };
+            if (!e.in_flight)
+            {
+                e.in_flight = true;
+                break;
+            }
+            // An asynchronous query completes through its io_context, which may be waiting on this very
+            // thread, so the lookup is run here instead of waiting for it.
+            if (e.async)
+                break;
+            cv_.wait(lock);
+        }
     }
-    if (pos == str.size() - 1)
+    _Resolver_lookup result{};
+    try
     {
-        ec = make_error_code(errc::invalid_argument);
-        return network_v6{};
+        result = lookup();
     }
-    auto end{ str.find_first_not_of("0123456789", pos + 1) };
-    if (end != string::npos)
+    catch (...)
     {
-        ec = make_error_code(errc::invalid_argument);
-        return network_v6{};
+        // Release the threads waiting for this query before giving up.
+        result.ec = make_error_code(resolver_errc::try_again);
+        _Complete(key, move(result));
+        throw;
     }
-    const address_v6 addr{ make_address_v6(str.substr(0, pos), ec) };
-    if (ec)
-        return network_v6{};
-    long prefix_len{ strtol(str.substr(pos + 1).c_str(), nullptr, 10) };
-    if (prefix_len < 0 || prefix_len > 128)
+    return _Complete(key, move(result));
+}
+
+resolver_cache::_Lookup_ptr resolver_cache::_Find_or_wait(const _Resolver_key& key, _Waiter&& waiter, bool& leader)
+{
+    lock_guard<mutex> lock{ mtx_ };
+    if (_Lookup_ptr p{ _Find(key) })
+        return p;
+    _Entry& e{ entries_[key] };
+    leader = !e.in_flight;
+    if (leader)
+        e.async = true;
+    e.in_flight = true;
+    e.waiters.push_back(move(waiter));
+    return nullptr;
+}
+
+resolver_cache::_Lookup_ptr resolver_cache::_Complete(const _Resolver_key& key, _Resolver_lookup&& lookup)
+{
+    vector<_Waiter> waiters;
+    _Lookup_ptr p;
     {
-        ec = make_error_code(errc::invalid_argument);
-        return network_v6{};
+        lock_guard<mutex> lock{ mtx_ };
+        lookup.expiry = clock_type::now() + (lookup.ec ? negative_ttl_ : ttl_);
+        p = make_shared<const _Resolver_lookup>(move(lookup));
+        _Entry& e{ entries_[key] };
+        e.lookup = p;
+        e.in_flight = false;
+        e.async = false;
+        waiters.swap(e.waiters);
+        if (entries_.size() > purge_size_)
+            _Purge();
+    }
+    cv_.notify_all();
+    for (_Waiter& w : waiters)
+        w(p);
+    return p;
+}
+
+void resolver_cache::_Purge()
+{
+    auto now{ clock_type::now() };
+    for (auto it{ entries_.begin() }; it != entries_.end();)
+    {
+        if (!it->second.in_flight && (!it->second.lookup || it->second.lookup->expiry <= now))
+            it = entries_.erase(it);
+        else
+            ++it;
     }
-    return network_v6{ addr, (int)prefix_len };
+    purge_size_ = max(_Purge_min, 2 * entries_.size());
+}
+
+void resolver_cache::shutdown() noexcept
+{
+    lock_guard<mutex> lock{ mtx_ };
+    entries_.clear();
 }
 } // namespace ip
 } // namespace v1
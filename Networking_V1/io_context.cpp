@@ -4,66 +4,622 @@ namespace std::experimental::net
 {
 inline namespace v1
 {
-struct _Io_context_monitor
+// Each thread keeps the contexts it is currently running in a stack of monitors on its own call stack,
+// so running_in_this_thread never touches shared state.
+class _Io_context_monitor
 {
-    _Io_context_monitor(io_context& ctx) : ctx_(&ctx)
+public:
+    explicit _Io_context_monitor(const io_context& ctx) noexcept : ctx_(&ctx), next_(top_) { top_ = this; }
+    ~_Io_context_monitor() { top_ = next_; }
+
+    _Io_context_monitor(const _Io_context_monitor&) = delete;
+    _Io_context_monitor& operator=(const _Io_context_monitor&) = delete;
+
+    static bool contains(const io_context& ctx) noexcept
     {
-        lock_guard<mutex> lock{ ctx_->mtx_ };
-        ctx_->call_stack_.push_back(this_thread::get_id());
+        for (const _Io_context_monitor* m{ top_ }; m; m = m->next_)
+        {
+            if (m->ctx_ == &ctx)
+                return true;
+        }
+        return false;
     }
-    ~_Io_context_monitor()
+
+private:
+    const io_context* ctx_;
+    const _Io_context_monitor* next_;
+
+    static thread_local const _Io_context_monitor* top_;
+};
+
+thread_local const _Io_context_monitor* _Io_context_monitor::top_{ nullptr };
+
+// The status of a completed overlapped operation is kept as an NTSTATUS in OVERLAPPED::Internal.
+static DWORD _Nt_status_to_dos_error(ULONG_PTR status) noexcept
+{
+    using func_type = ULONG(WINAPI*)(LONG);
+    static const func_type func{ reinterpret_cast<func_type>(::GetProcAddress(::GetModuleHandleW(L"ntdll.dll"), "RtlNtStatusToDosError")) };
+    return func ? func(static_cast<LONG>(status)) : ERROR_UNEXP_NET_ERR;
+}
+
+// A request queue of one socket. RIOReceive and RIOSend on a queue are serialised by its own lock,
+// and the queue stays alive until the socket has closed it and its last request has been dequeued.
+struct _Rio_queue
+{
+    ::RIO_RQ rq;
+    mutex mtx;
+    atomic<size_t> refs;
+    bool closed;
+    bool receive_deferred;
+    bool send_deferred;
+};
+
+// Registered I/O: datagram receives and sends go through a slab of registered buffers,
+// requests issued from handlers are deferred and committed once per batch,
+// and completions are dequeued in bulk when the completion queue signals the port.
+class io_context::_Registered_io
+{
+public:
+    static constexpr ULONG queue_depth{ 64 };
+    static constexpr size_t slot_size{ 16384 };
+    static constexpr size_t slot_count{ 1024 };
+
+    explicit _Registered_io(HANDLE port) : table(), cq(RIO_INVALID_CQ), cq_size(queue_depth * 2), queues(0), notify(), buffer_id(RIO_INVALID_BUFFERID), slab(nullptr), dirty(false)
     {
-        lock_guard<mutex> lock{ ctx_->mtx_ };
-        ctx_->call_stack_.erase(find(ctx_->call_stack_.begin(), ctx_->call_stack_.end(), this_thread::get_id()));
+        SOCKET s{ ::WSASocketW(AF_INET, SOCK_DGRAM, IPPROTO_UDP, nullptr, 0, WSA_FLAG_OVERLAPPED | WSA_FLAG_REGISTERED_IO) };
+        if (s == INVALID_SOCKET)
+            throw system_error{ error_code{ ::WSAGetLastError(), generic_category() }, "io_context" };
+        GUID id = WSAID_MULTIPLE_RIO;
+        DWORD bytes{ 0 };
+        table.cbSize = sizeof(table);
+        int r{ ::WSAIoctl(s, SIO_GET_MULTIPLE_EXTENSION_FUNCTION_POINTER, &id, sizeof(id), &table, sizeof(table), &bytes, nullptr, nullptr) };
+        int err{ ::WSAGetLastError() };
+        ::closesocket(s);
+        if (r != 0)
+            throw system_error{ error_code{ err, generic_category() }, "io_context" };
+        ::RIO_NOTIFICATION_COMPLETION nc{};
+        nc.Type = RIO_IOCP_COMPLETION;
+        nc.Iocp.IocpHandle = port;
+        nc.Iocp.CompletionKey = nullptr;
+        nc.Iocp.Overlapped = &notify;
+        cq = table.RIOCreateCompletionQueue(cq_size, &nc);
+        if (cq == RIO_INVALID_CQ)
+            throw system_error{ error_code{ ::WSAGetLastError(), generic_category() }, "io_context" };
+        slab = static_cast<char*>(::VirtualAlloc(nullptr, slot_size * slot_count, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+        if (!slab)
+        {
+            error_code ec{ static_cast<int>(::GetLastError()), generic_category() };
+            table.RIOCloseCompletionQueue(cq);
+            throw system_error{ ec, "io_context" };
+        }
+        buffer_id = table.RIORegisterBuffer(slab, static_cast<DWORD>(slot_size * slot_count));
+        if (buffer_id == RIO_INVALID_BUFFERID)
+        {
+            error_code ec{ ::WSAGetLastError(), generic_category() };
+            ::VirtualFree(slab, 0, MEM_RELEASE);
+            table.RIOCloseCompletionQueue(cq);
+            throw system_error{ ec, "io_context" };
+        }
+        free_slots.reserve(slot_count);
+        for (size_t i{ slot_count }; i > 0; --i)
+            free_slots.push_back(i - 1);
+        table.RIONotify(cq);
     }
 
-private:
-    io_context* ctx_;
+    ~_Registered_io()
+    {
+        table.RIODeregisterBuffer(buffer_id);
+        ::VirtualFree(slab, 0, MEM_RELEASE);
+        table.RIOCloseCompletionQueue(cq);
+    }
+
+    ::RIO_EXTENSION_FUNCTION_TABLE table;
+    // Guards the completion queue: dequeue, notify, resize, and the count of queues sized into it.
+    mutex cq_mtx;
+    ::RIO_CQ cq;
+    DWORD cq_size;
+    DWORD queues;
+    ::OVERLAPPED notify;
+    ::RIO_BUFFERID buffer_id;
+    char* slab;
+    mutex slot_mtx;
+    vector<size_t> free_slots;
+    // Queues with deferred requests, each holding a reference until it is committed.
+    mutex pending_mtx;
+    vector<_Rio_queue*> pending;
+    atomic<bool> dirty;
 };
 
-size_t io_context::_Do_one(DWORD msec)
+io_context::io_context(int concurrency_hint, backend_type backend) : stopped_(false), outstanding_work_(0), timer_queues_(nullptr), timer_ops_(0)
+{
+    WSAData data;
+    ::WSAStartup(WINSOCK_VERSION, &data);
+    port_ = ::CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, concurrency_hint < 0 ? 0 : concurrency_hint);
+    if (!port_)
+    {
+        error_code ec{ static_cast<int>(::GetLastError()), generic_category() };
+        ::WSACleanup();
+        throw system_error{ ec, "io_context" };
+    }
+    if (backend == backend_type::registered_io)
+    {
+        try
+        {
+            rio_ = make_unique<_Registered_io>(port_);
+        }
+        catch (...)
+        {
+            ::CloseHandle(port_);
+            ::WSACleanup();
+            throw;
+        }
+    }
+}
+
+io_context::~io_context()
+{
+    stop();
+    shutdown();
+    destroy();
+    ::OVERLAPPED_ENTRY entries[_Batch_max];
+    ULONG count{ 0 };
+    while (::GetQueuedCompletionStatusEx(port_, entries, static_cast<ULONG>(_Batch_max), &count, 0, FALSE))
+    {
+        for (ULONG i{ 0 }; i < count; ++i)
+        {
+            if (entries[i].lpOverlapped && (!rio_ || entries[i].lpOverlapped != &rio_->notify))
+                static_cast<_Io_operation*>(entries[i].lpOverlapped)->_Destroy();
+        }
+    }
+    if (rio_)
+    {
+        ::RIORESULT results[_Batch_max];
+        ULONG n{ 0 };
+        while ((n = rio_->table.RIODequeueCompletion(rio_->cq, results, static_cast<ULONG>(_Batch_max))) != 0 && n != RIO_CORRUPT_CQ)
+        {
+            for (ULONG i{ 0 }; i < n; ++i)
+            {
+                _Rio_operation* op{ reinterpret_cast<_Rio_operation*>(static_cast<ULONG_PTR>(results[i].RequestContext)) };
+                _Rio_release_queue(op->queue);
+                op->_Destroy();
+            }
+        }
+        for (_Rio_queue* q : rio_->pending)
+            _Rio_release_queue(q);
+        rio_.reset();
+    }
+    ::CloseHandle(port_);
+    ::WSACleanup();
+}
+
+size_t io_context::_Do_some(DWORD msec, size_t max_count)
 {
-    DWORD n;
-    ULONG_PTR key{ 0 };
-    _Io_operation* p;
     _Io_context_monitor mon{ *this };
-    if (::GetQueuedCompletionStatus(port_, &n, &key, (LPOVERLAPPED*)&p, msec))
+    // Requests issued by the handlers below are committed together once the batch is done.
+    struct _Flush_guard
+    {
+        ~_Flush_guard()
+        {
+            if (ctx->rio_)
+                ctx->_Rio_flush();
+        }
+
+        io_context* ctx;
+    } guard{ this };
+    ULONGLONG start{ msec == INFINITE ? 0 : ::GetTickCount64() };
+    for (bool first{ true };; first = false)
+    {
+        if (stopped())
+            return 0;
+        if (outstanding_work_.load(memory_order_acquire) == 0)
+        {
+            stop();
+            return 0;
+        }
+        bool timers{ timer_ops_.load(memory_order_acquire) != 0 };
+        if (size_t n{ timers ? _Complete_timers(max_count) : 0 })
+            return n;
+        DWORD wait{ msec };
+        if (msec != INFINITE)
+        {
+            ULONGLONG elapsed{ ::GetTickCount64() - start };
+            if (!first && elapsed >= msec)
+                return 0;
+            wait = elapsed >= msec ? 0 : static_cast<DWORD>(msec - elapsed);
+        }
+        if (timers)
+            wait = _Timer_wait_msec(wait);
+        ::OVERLAPPED_ENTRY entries[_Batch_max];
+        ULONG count{ 0 };
+        if (!::GetQueuedCompletionStatusEx(port_, entries, static_cast<ULONG>(min(max_count, _Batch_max)), &count, wait, FALSE))
+        {
+            // A timeout may only mean that the earliest timer is due.
+            if (::GetLastError() != WAIT_TIMEOUT)
+                return 0;
+            continue;
+        }
+        size_t n{ 0 };
+        for (ULONG i{ 0 }; i < count; ++i)
+        {
+            ::OVERLAPPED_ENTRY& e{ entries[i] };
+            if (stopped())
+            {
+                // Hand the rest of the batch back, so that it survives a restart() and wakes other threads.
+                ::PostQueuedCompletionStatus(port_, e.dwNumberOfBytesTransferred, e.lpCompletionKey, e.lpOverlapped);
+                continue;
+            }
+            if (!e.lpOverlapped)
+                continue;
+            if (rio_ && e.lpOverlapped == &rio_->notify)
+            {
+                try
+                {
+                    n += _Rio_complete(max_count > n ? max_count - n : 1);
+                }
+                catch (...)
+                {
+                    for (++i; i < count; ++i)
+                        ::PostQueuedCompletionStatus(port_, entries[i].dwNumberOfBytesTransferred, entries[i].lpCompletionKey, entries[i].lpOverlapped);
+                    throw;
+                }
+                continue;
+            }
+            _Io_operation* op{ static_cast<_Io_operation*>(e.lpOverlapped) };
+            DWORD err{ e.lpCompletionKey ? static_cast<DWORD>(e.lpCompletionKey) : (op->Internal ? _Nt_status_to_dos_error(op->Internal) : 0) };
+            try
+            {
+                op->_Complete(err ? error_code{ static_cast<int>(err), generic_category() } : error_code{}, e.dwNumberOfBytesTransferred);
+            }
+            catch (...)
+            {
+                for (++i; i < count; ++i)
+                    ::PostQueuedCompletionStatus(port_, entries[i].dwNumberOfBytesTransferred, entries[i].lpCompletionKey, entries[i].lpOverlapped);
+                _Work_finished();
+                throw;
+            }
+            _Work_finished();
+            ++n;
+        }
+        // A batch of wake-ups only means that the timeout has to be computed again.
+        if (n)
+            return n;
+    }
+}
+
+size_t io_context::_Complete_timers(size_t max_count)
+{
+    _Timer_op* list{ nullptr };
+    size_t count{ 0 };
+    {
+        lock_guard<mutex> lock{ timer_mtx_ };
+        for (_Timer_queue_base* q{ timer_queues_ }; q && count < max_count; q = q->next_)
+            count += q->_Take_ready(list, max_count - count);
+        timer_ops_.fetch_sub(count, memory_order_relaxed);
+    }
+    while (_Timer_op* op{ list })
+    {
+        list = op->next;
+        try
+        {
+            op->_Complete(error_code{}, 0);
+        }
+        catch (...)
+        {
+            while (_Timer_op* rest{ list })
+            {
+                list = rest->next;
+                ::PostQueuedCompletionStatus(port_, 0, 0, rest);
+            }
+            _Work_finished();
+            throw;
+        }
+        _Work_finished();
+    }
+    return count;
+}
+
+DWORD io_context::_Timer_wait_msec(DWORD msec)
+{
+    lock_guard<mutex> lock{ timer_mtx_ };
+    for (_Timer_queue_base* q{ timer_queues_ }; q; q = q->next_)
+        msec = q->_Wait_msec(msec);
+    return msec;
+}
+
+void io_context::_Add_timer_queue(_Timer_queue_base& q)
+{
+    lock_guard<mutex> lock{ timer_mtx_ };
+    q.next_ = timer_queues_;
+    timer_queues_ = &q;
+}
+
+void io_context::_Remove_timer_queue(_Timer_queue_base& q)
+{
+    lock_guard<mutex> lock{ timer_mtx_ };
+    for (_Timer_queue_base** p{ &timer_queues_ }; *p; p = &(*p)->next_)
     {
-        p->operation(p, n);
-        ::WSACloseEvent(p->overlapped.hEvent);
-        delete p;
-        return 1;
+        if (*p == &q)
+        {
+            *p = q.next_;
+            break;
+        }
     }
-    else
+}
+
+void io_context::_Shutdown_timer_queue(_Timer_queue_base& q) noexcept
+{
+    _Timer_op* list{ nullptr };
     {
-        return 0;
+        lock_guard<mutex> lock{ timer_mtx_ };
+        q._Take_all(list);
+        for (_Timer_op* op{ list }; op; op = op->next)
+            timer_ops_.fetch_sub(1, memory_order_relaxed);
+    }
+    while (_Timer_op* op{ list })
+    {
+        list = op->next;
+        op->_Destroy();
     }
 }
 
-size_t io_context::poll_one()
+size_t io_context::_Rio_complete(size_t max_count)
 {
-    if (_Do_one(0))
-        return 1;
-    else
+    ::RIORESULT results[_Batch_max];
+    ULONG count{ 0 };
+    {
+        lock_guard<mutex> lock{ rio_->cq_mtx };
+        count = rio_->table.RIODequeueCompletion(rio_->cq, results, static_cast<ULONG>(min(max_count, _Batch_max)));
+        rio_->table.RIONotify(rio_->cq);
+    }
+    if (count == RIO_CORRUPT_CQ)
+        throw system_error{ error_code{ ::WSAGetLastError(), generic_category() }, "run" };
+    // The entries are free once dequeued, so the queues may give back their capacity before the handlers run.
+    for (ULONG i{ 0 }; i < count; ++i)
+        _Rio_release_queue(reinterpret_cast<_Rio_operation*>(static_cast<ULONG_PTR>(results[i].RequestContext))->queue);
+    size_t n{ 0 };
+    for (ULONG i{ 0 }; i < count; ++i)
     {
-        stop();
-        return 0;
+        ::RIORESULT& r{ results[i] };
+        _Rio_operation* p{ reinterpret_cast<_Rio_operation*>(static_cast<ULONG_PTR>(r.RequestContext)) };
+        if (stopped())
+        {
+            ::PostQueuedCompletionStatus(port_, r.BytesTransferred, static_cast<ULONG_PTR>(r.Status), p);
+            continue;
+        }
+        try
+        {
+            p->_Complete(r.Status ? error_code{ static_cast<int>(r.Status), generic_category() } : error_code{}, r.BytesTransferred);
+        }
+        catch (...)
+        {
+            for (++i; i < count; ++i)
+                ::PostQueuedCompletionStatus(port_, results[i].BytesTransferred, static_cast<ULONG_PTR>(results[i].Status), reinterpret_cast<_Rio_operation*>(static_cast<ULONG_PTR>(results[i].RequestContext)));
+            _Work_finished();
+            throw;
+        }
+        _Work_finished();
+        ++n;
     }
+    return n;
+}
+
+void io_context::_Rio_flush()
+{
+    if (!rio_->dirty.load(memory_order_acquire))
+        return;
+    vector<_Rio_queue*> pending;
+    {
+        lock_guard<mutex> lock{ rio_->pending_mtx };
+        pending.swap(rio_->pending);
+        rio_->dirty.store(false, memory_order_relaxed);
+    }
+    for (_Rio_queue* q : pending)
+    {
+        {
+            lock_guard<mutex> lock{ q->mtx };
+            if (!q->closed)
+            {
+                if (q->receive_deferred)
+                    rio_->table.RIOReceive(q->rq, nullptr, 0, RIO_MSG_COMMIT_ONLY, nullptr);
+                if (q->send_deferred)
+                    rio_->table.RIOSend(q->rq, nullptr, 0, RIO_MSG_COMMIT_ONLY, nullptr);
+            }
+            q->receive_deferred = false;
+            q->send_deferred = false;
+        }
+        _Rio_release_queue(q);
+    }
+}
+
+// Every request queue may fill queue_depth entries of the completion queue for each direction.
+// The completion queue grows when more queues are open than it has room for, and the room of
+// closed queues is used again once their requests have been dequeued.
+_Rio_queue* io_context::_Rio_request_queue(SOCKET s)
+{
+    if (!rio_)
+        return nullptr;
+    unique_ptr<_Rio_queue> q{ new _Rio_queue{} };
+    q->refs.store(1, memory_order_relaxed);
+    lock_guard<mutex> lock{ rio_->cq_mtx };
+    DWORD size{ (rio_->queues + 1) * _Registered_io::queue_depth * 2 };
+    if (size > rio_->cq_size)
+    {
+        if (!rio_->table.RIOResizeCompletionQueue(rio_->cq, size))
+            return nullptr;
+        rio_->cq_size = size;
+    }
+    q->rq = rio_->table.RIOCreateRequestQueue(s, _Registered_io::queue_depth, 1, _Registered_io::queue_depth, 1, rio_->cq, rio_->cq, nullptr);
+    if (q->rq == RIO_INVALID_RQ)
+        return nullptr;
+    ++rio_->queues;
+    return q.release();
+}
+
+void io_context::_Rio_close_request_queue(_Rio_queue* q) noexcept
+{
+    {
+        lock_guard<mutex> lock{ q->mtx };
+        q->closed = true;
+    }
+    _Rio_release_queue(q);
+}
+
+void io_context::_Rio_release_queue(_Rio_queue* q) noexcept
+{
+    if (q->refs.fetch_sub(1, memory_order_acq_rel) != 1)
+        return;
+    {
+        lock_guard<mutex> lock{ rio_->cq_mtx };
+        --rio_->queues;
+    }
+    delete q;
+}
+
+char* io_context::_Rio_acquire(size_t size, ::RIO_BUF& buffer)
+{
+    if (!rio_ || size > _Registered_io::slot_size)
+        return nullptr;
+    size_t slot;
+    {
+        lock_guard<mutex> lock{ rio_->slot_mtx };
+        if (rio_->free_slots.empty())
+            return nullptr;
+        slot = rio_->free_slots.back();
+        rio_->free_slots.pop_back();
+    }
+    buffer.BufferId = rio_->buffer_id;
+    buffer.Offset = static_cast<ULONG>(slot * _Registered_io::slot_size);
+    buffer.Length = static_cast<ULONG>(size);
+    return rio_->slab + buffer.Offset;
+}
+
+void io_context::_Rio_release(const ::RIO_BUF& buffer) noexcept
+{
+    lock_guard<mutex> lock{ rio_->slot_mtx };
+    rio_->free_slots.push_back(buffer.Offset / _Registered_io::slot_size);
+}
+
+int io_context::_Rio_receive(_Rio_queue* q, _Rio_operation* op) { return _Rio_request(q, op, true); }
+
+int io_context::_Rio_send(_Rio_queue* q, _Rio_operation* op) { return _Rio_request(q, op, false); }
+
+// A request holds a reference to its queue until it is dequeued. A request from a handler of this
+// context is deferred, and the first one deferred on a queue lists the queue for the commit.
+int io_context::_Rio_request(_Rio_queue* q, _Rio_operation* op, bool receive)
+{
+    bool defer{ get_executor().running_in_this_thread() };
+    bool list{ false };
+    op->queue = q;
+    q->refs.fetch_add(1, memory_order_relaxed);
+    {
+        lock_guard<mutex> lock{ q->mtx };
+        DWORD flags{ defer ? RIO_MSG_DEFER : 0u };
+        if (!(receive ? rio_->table.RIOReceive(q->rq, op->buffer.get(), 1, flags, op) : rio_->table.RIOSend(q->rq, op->buffer.get(), 1, flags, op)))
+        {
+            int err{ ::WSAGetLastError() };
+            q->refs.fetch_sub(1, memory_order_relaxed);
+            return err;
+        }
+        if (defer)
+        {
+            list = !q->receive_deferred && !q->send_deferred;
+            (receive ? q->receive_deferred : q->send_deferred) = true;
+        }
+    }
+    if (list)
+    {
+        q->refs.fetch_add(1, memory_order_relaxed);
+        lock_guard<mutex> lock{ rio_->pending_mtx };
+        rio_->pending.push_back(q);
+        rio_->dirty.store(true, memory_order_release);
+    }
+    return 0;
+}
+
+bool io_context::_Running_in_this_thread() const noexcept
+{
+    return _Io_context_monitor::contains(*this);
 }
 
 void io_context::stop()
 {
-    ::PostQueuedCompletionStatus(port_, 0, 0, nullptr);
-    ::CloseHandle(port_);
-    port_ = nullptr;
-    ::WSACleanup();
+    if (!stopped_.exchange(true, memory_order_acq_rel))
+        ::PostQueuedCompletionStatus(port_, 0, 0, nullptr);
 }
 
-void io_context::_Start()
+void io_context::_Post(_Io_operation* op, DWORD err)
 {
-    WSAData data;
-    ::WSAStartup(WINSOCK_VERSION, &data);
-    port_ = ::CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, concurrency_hint_);
+    if (!::PostQueuedCompletionStatus(port_, 0, err, op))
+    {
+        error_code ec{ static_cast<int>(::GetLastError()), generic_category() };
+        op->_Destroy();
+        _Work_finished();
+        throw system_error{ ec, "post" };
+    }
+}
+
+// Pins the calling thread to a processor, numbered across all processor groups.
+static void _Pin_to_processor(size_t index) noexcept
+{
+    index %= ::GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+    for (WORD group{ 0 }, groups{ ::GetActiveProcessorGroupCount() }; group < groups; ++group)
+    {
+        DWORD count{ ::GetActiveProcessorCount(group) };
+        if (index < count)
+        {
+            ::GROUP_AFFINITY affinity{};
+            affinity.Group = group;
+            affinity.Mask = KAFFINITY{ 1 } << index;
+            ::SetThreadGroupAffinity(::GetCurrentThread(), &affinity, nullptr);
+            return;
+        }
+        index -= count;
+    }
+}
+
+io_context_pool::io_context_pool(size_t size, io_context::backend_type backend) : next_(0)
+{
+    size = max<size_t>(size, 1);
+    contexts_.reserve(size);
+    work_.reserve(size);
+    for (size_t i{ 0 }; i < size; ++i)
+    {
+        // Each context is run by one thread only.
+        contexts_.push_back(make_unique<io_context>(1, backend));
+        work_.emplace_back(contexts_.back()->get_executor());
+    }
+}
+
+io_context_pool::~io_context_pool()
+{
+    stop();
+    join();
+}
+
+void io_context_pool::run()
+{
+    threads_.reserve(contexts_.size());
+    for (size_t i{ 0 }; i < contexts_.size(); ++i)
+    {
+        threads_.emplace_back([this, i] {
+            _Pin_to_processor(i);
+            contexts_[i]->run();
+        });
+    }
+}
+
+void io_context_pool::stop()
+{
+    work_.clear();
+    for (auto& ctx : contexts_)
+        ctx->stop();
+}
+
+void io_context_pool::join()
+{
+    for (auto& t : threads_)
+        t.join();
+    threads_.clear();
 }
 } // namespace v1
 } // namespace std::experimental::net